@@ -0,0 +1,242 @@
+#include "BodyPositionDeduplicator.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/MessageView>
+#include <cnoid/EigenUtil>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QPushButton>
+#include <QBoxLayout>
+#include <QLabel>
+#include <QDoubleSpinBox>
+#include <QCheckBox>
+#include <fmt/format.h>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+
+namespace {
+
+// The items of different bodies are never regarded as duplicates
+struct CellKey
+{
+    BodyItem* owner;
+    int x, y, z;
+    bool operator==(const CellKey& key) const {
+        return owner == key.owner && x == key.x && y == key.y && z == key.z;
+    }
+};
+
+struct CellKeyHash
+{
+    size_t operator()(const CellKey& key) const
+    {
+        return hash<BodyItem*>()(key.owner) ^
+            (size_t(key.x) * 73856093u) ^ (size_t(key.y) * 19349663u) ^ (size_t(key.z) * 83492791u);
+    }
+};
+
+double getRotationAngle(const Quaternion& q1, const Quaternion& q2)
+{
+    return 2.0 * std::acos(std::min(1.0, std::abs(q1.dot(q2))));
+}
+
+}
+
+BodyPositionDeduplicator::BodyPositionDeduplicator()
+{
+    numDuplicates_ = 0;
+    translationTolerance_ = 0.01;
+    rotationTolerance_ = radian(1.0);
+}
+
+void BodyPositionDeduplicator::setTranslationTolerance(double tolerance)
+{
+    // The tolerance is also the cell size of the grid
+    translationTolerance_ = std::max(tolerance, 1.0e-6);
+}
+
+void BodyPositionDeduplicator::setRotationTolerance(double tolerance)
+{
+    rotationTolerance_ = std::max(tolerance, 0.0);
+}
+
+int BodyPositionDeduplicator::findDuplicates(const cnoid::ItemList<BodyPositionItem>& items)
+{
+    BodyPositionTrace::Span span("BodyPositionDeduplicator::findDuplicates");
+    clusters.clear();
+    numDuplicates_ = 0;
+    unordered_map<CellKey, vector<int>, CellKeyHash> cells;
+    cells.reserve(items.size());
+
+    for(auto& item : items){
+        item->ensureLoaded();
+        auto& p = item->translation();
+        auto& q = item->rotation();
+        auto owner = item->ownerBodyItem();
+        CellKey key = { owner,
+                        static_cast<int>(std::floor(p.x() / translationTolerance_)),
+                        static_cast<int>(std::floor(p.y() / translationTolerance_)),
+                        static_cast<int>(std::floor(p.z() / translationTolerance_)) };
+
+        int nearestCluster = -1;
+        double minDistance = translationTolerance_;
+        for(int dx = -1; dx <= 1; ++dx){
+            for(int dy = -1; dy <= 1; ++dy){
+                for(int dz = -1; dz <= 1; ++dz){
+                    auto cell = cells.find({ owner, key.x + dx, key.y + dy, key.z + dz });
+                    if(cell == cells.end()){
+                        continue;
+                    }
+                    for(auto& index : cell->second){
+                        auto& representative = clusters[index].representative;
+                        double d = (representative->translation() - p).norm();
+                        if(d <= minDistance &&
+                           getRotationAngle(representative->rotation(), q) <= rotationTolerance_){
+                            nearestCluster = index;
+                            minDistance = d;
+                        }
+                    }
+                }
+            }
+        }
+        if(nearestCluster >= 0){
+            clusters[nearestCluster].duplicates.push_back(item);
+            ++numDuplicates_;
+        } else {
+            cells[key].push_back(clusters.size());
+            clusters.emplace_back();
+            clusters.back().representative = item;
+        }
+    }
+
+    return numDuplicates_;
+}
+
+int BodyPositionDeduplicator::numClustersWithDuplicates() const
+{
+    return std::count_if(clusters.begin(), clusters.end(),
+                         [](const Cluster& cluster){ return !cluster.duplicates.empty(); });
+}
+
+void BodyPositionDeduplicator::apply(Operation operation)
+{
+    BodyPositionTrace::Span span("BodyPositionDeduplicator::apply");
+
+    BodyPositionItem::beginItemsInProjectChangeBatch();
+
+    for(auto& cluster : clusters){
+        if(cluster.duplicates.empty()){
+            continue;
+        }
+        if(operation == Merge){
+            // The quaternions are averaged on the hemisphere of the representative
+            auto& q0 = cluster.representative->rotation();
+            Vector3 p = cluster.representative->translation();
+            Vector4 qsum = q0.coeffs();
+            for(auto& item : cluster.duplicates){
+                p += item->translation();
+                auto& q = item->rotation();
+                if(q.dot(q0) < 0.0){
+                    qsum -= q.coeffs();
+                } else {
+                    qsum += q.coeffs();
+                }
+            }
+            Quaternion qmean;
+            qmean.coeffs() = qsum.normalized();
+            Isometry3 T;
+            T.linear() = qmean.toRotationMatrix();
+            T.translation() = p / (cluster.duplicates.size() + 1);
+            cluster.representative->setPosition(T);
+        }
+        for(auto& item : cluster.duplicates){
+            item->removeFromParentItem();
+        }
+    }
+
+    BodyPositionItem::endItemsInProjectChangeBatch();
+
+    mvout() << format("{0} duplicate body positions have been {1}.",
+                      numDuplicates_, (operation == Merge) ? "merged" : "deleted") << endl;
+
+    clusters.clear();
+    numDuplicates_ = 0;
+}
+
+/**
+   The duplicates are counted whenever the tolerances are changed, and the merging or the
+   deletion is applied to them. The selected items are the targets if there are any.
+*/
+void BodyPositionDeduplicator::deduplicateWithDialog()
+{
+    QDialog dialog;
+    dialog.setWindowTitle("Remove Duplicate Body Positions");
+    auto vbox = new QVBoxLayout;
+    dialog.setLayout(vbox);
+
+    auto hbox = new QHBoxLayout;
+    hbox->addWidget(new QLabel("Translation tolerance [m]"));
+    auto translationSpin = new QDoubleSpinBox;
+    translationSpin->setDecimals(3);
+    translationSpin->setRange(0.001, 1.0);
+    translationSpin->setSingleStep(0.001);
+    translationSpin->setValue(0.01);
+    hbox->addWidget(translationSpin);
+    hbox->addWidget(new QLabel("Rotation tolerance [deg]"));
+    auto rotationSpin = new QDoubleSpinBox;
+    rotationSpin->setDecimals(1);
+    rotationSpin->setRange(0.0, 180.0);
+    rotationSpin->setValue(1.0);
+    hbox->addWidget(rotationSpin);
+    vbox->addLayout(hbox);
+
+    auto selectedCheck = new QCheckBox("Selected items only");
+    selectedCheck->setChecked(BodyPositionItem::numSelectedRegisteredItems() > 0);
+    selectedCheck->setEnabled(BodyPositionItem::numSelectedRegisteredItems() > 0);
+    vbox->addWidget(selectedCheck);
+
+    auto resultLabel = new QLabel;
+    vbox->addWidget(resultLabel);
+
+    auto buttonBox = new QDialogButtonBox;
+    auto mergeButton = buttonBox->addButton("Merge", QDialogButtonBox::ActionRole);
+    auto deleteButton = buttonBox->addButton("Delete", QDialogButtonBox::ActionRole);
+    buttonBox->addButton(QDialogButtonBox::Cancel);
+    vbox->addWidget(buttonBox);
+
+    BodyPositionDeduplicator deduplicator;
+    Operation operation = Delete;
+
+    auto updateDuplicates =
+        [&](){
+            deduplicator.setTranslationTolerance(translationSpin->value());
+            deduplicator.setRotationTolerance(radian(rotationSpin->value()));
+            int n = deduplicator.findDuplicates(
+                selectedCheck->isChecked() ?
+                BodyPositionItem::selectedRegisteredItems() : BodyPositionItem::registeredItems());
+            resultLabel->setText(
+                format("{0} duplicates in {1} clusters", n, deduplicator.numClustersWithDuplicates()).c_str());
+            mergeButton->setEnabled(n > 0);
+            deleteButton->setEnabled(n > 0);
+        };
+    updateDuplicates();
+
+    QObject::connect(translationSpin, (void(QDoubleSpinBox::*)(double)) &QDoubleSpinBox::valueChanged,
+                     [&](double){ updateDuplicates(); });
+    QObject::connect(rotationSpin, (void(QDoubleSpinBox::*)(double)) &QDoubleSpinBox::valueChanged,
+                     [&](double){ updateDuplicates(); });
+    QObject::connect(selectedCheck, &QCheckBox::toggled, [&](bool){ updateDuplicates(); });
+    QObject::connect(mergeButton, &QPushButton::clicked, [&](){ operation = Merge; dialog.accept(); });
+    QObject::connect(deleteButton, &QPushButton::clicked, [&](){ operation = Delete; dialog.accept(); });
+    QObject::connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    if(dialog.exec() == QDialog::Accepted){
+        // The items may have been changed while the dialog was shown
+        updateDuplicates();
+        deduplicator.apply(operation);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_DEDUPLICATOR_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_DEDUPLICATOR_H
+
+#include "BodyPositionItem.h"
+#include <vector>
+
+/**
+   This class finds the body position items of the same body whose positions are almost
+   identical and merges or deletes them.
+
+   The items are clustered in the given order. The first item of a cluster is its
+   representative, and an item joins the cluster of the nearest representative within the
+   tolerances. The representatives are hashed into the grid of the translation tolerance, so
+   only the representatives in the neighboring cells are compared with an item.
+*/
+class BodyPositionDeduplicator
+{
+public:
+    BodyPositionDeduplicator();
+
+    void setTranslationTolerance(double tolerance);
+    double translationTolerance() const { return translationTolerance_; }
+    // The tolerance is the angle between the rotations in radian
+    void setRotationTolerance(double tolerance);
+    double rotationTolerance() const { return rotationTolerance_; }
+
+    // Returns the number of the duplicates
+    int findDuplicates(const cnoid::ItemList<BodyPositionItem>& items);
+    int numDuplicates() const { return numDuplicates_; }
+    int numClustersWithDuplicates() const;
+
+    /**
+       The duplicates are removed from the project in a single batch. The representative is
+       moved to the mean position of its cluster by the merging.
+    */
+    enum Operation { Delete, Merge };
+    void apply(Operation operation);
+
+    static void deduplicateWithDialog();
+
+private:
+    struct Cluster
+    {
+        BodyPositionItemPtr representative;
+        std::vector<BodyPositionItemPtr> duplicates;
+    };
+    std::vector<Cluster> clusters;
+    int numDuplicates_;
+    double translationTolerance_;
+    double rotationTolerance_;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_DEDUPLICATOR_H
@@ -0,0 +1,336 @@
+#include "BodyPositionFileSaver.h"
+#include "BodyPositionWriter.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/Timer>
+#include <cnoid/LazyCaller>
+#include <cnoid/MessageView>
+#include <cnoid/ValueTree>
+#include <cnoid/stdx/filesystem>
+#include <fmt/format.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+
+namespace {
+
+const int SaveDelay = 1000; // msec
+
+struct Job
+{
+    int id;
+    BodyPositionItem* item; // Only used as the key on the GUI thread
+    string filename;
+    vector<char> text;
+};
+
+struct SavingItemInfo
+{
+    BodyPositionItemPtr item;
+    int latestJobId;
+};
+
+}
+
+class BodyPositionFileSaver::Impl
+{
+public:
+    Timer timer;
+    map<BodyPositionItem*, BodyPositionItemPtr> dirtyItems;
+    map<BodyPositionItem*, SavingItemInfo> savingItems;
+    int jobIdCounter;
+
+    // The completions posted to the GUI thread are ignored after the instance is deleted
+    shared_ptr<bool> liveness;
+
+    thread workerThread;
+    mutex jobMutex;
+    condition_variable jobCondition;
+    condition_variable completionCondition;
+    deque<Job> jobs;
+    int numUnfinishedJobs;
+    bool isWorkerStopping;
+
+    Impl();
+    ~Impl();
+    void saveDirtyItems();
+    void startJob(BodyPositionItem* item);
+    void run();
+    void onJobFinished(BodyPositionItem* item, int jobId, const string& filename, const string& error);
+};
+
+
+BodyPositionFileSaver* BodyPositionFileSaver::instance()
+{
+    static BodyPositionFileSaver saver;
+    return &saver;
+}
+
+
+BodyPositionFileSaver::BodyPositionFileSaver()
+{
+    impl = new Impl;
+    isEnabled_ = true;
+    isAutoSavingEnabled_ = false;
+}
+
+
+BodyPositionFileSaver::Impl::Impl()
+{
+    timer.setSingleShot(true);
+    timer.setInterval(SaveDelay);
+    timer.sigTimeout().connect([this](){ saveDirtyItems(); });
+    jobIdCounter = 0;
+    liveness = make_shared<bool>(true);
+    numUnfinishedJobs = 0;
+    isWorkerStopping = false;
+}
+
+
+BodyPositionFileSaver::~BodyPositionFileSaver()
+{
+    delete impl;
+}
+
+
+BodyPositionFileSaver::Impl::~Impl()
+{
+    if(workerThread.joinable()){
+        {
+            lock_guard<mutex> lock(jobMutex);
+            isWorkerStopping = true;
+        }
+        jobCondition.notify_all();
+        workerThread.join();
+    }
+}
+
+
+void BodyPositionFileSaver::setEnabled(bool on)
+{
+    isEnabled_ = on && impl;
+    if(!on && impl){
+        impl->timer.stop();
+        impl->dirtyItems.clear();
+    }
+}
+
+
+void BodyPositionFileSaver::setAutoSavingEnabled(bool on)
+{
+    isAutoSavingEnabled_ = on;
+    if(!on && impl){
+        impl->timer.stop();
+        impl->dirtyItems.clear();
+    }
+}
+
+
+void BodyPositionFileSaver::requestSave(BodyPositionItem* item)
+{
+    if(isEnabled_ && isAutoSavingEnabled_ &&
+       !item->filePath().empty() && item->fileFormat() == "BODY-POSITION"){
+        impl->dirtyItems[item] = item;
+        impl->timer.start();
+    }
+}
+
+
+void BodyPositionFileSaver::requestSaveNow(BodyPositionItem* item)
+{
+    if(isEnabled_ && !item->filePath().empty() && item->fileFormat() == "BODY-POSITION"){
+        impl->dirtyItems.erase(item);
+        impl->startJob(item);
+    }
+}
+
+
+void BodyPositionFileSaver::cancelSave(BodyPositionItem* item)
+{
+    if(impl){
+        impl->dirtyItems.erase(item);
+    }
+}
+
+
+void BodyPositionFileSaver::Impl::saveDirtyItems()
+{
+    for(auto& kv : dirtyItems){
+        startJob(kv.second);
+    }
+    dirtyItems.clear();
+}
+
+
+void BodyPositionFileSaver::Impl::startJob(BodyPositionItem* item)
+{
+    BodyPositionTrace::Span span("BodyPositionFileSaver::startJob");
+    Job job;
+    job.id = ++jobIdCounter;
+    job.item = item;
+    job.filename = item->filePath();
+
+    // Only the snapshot of the text is made on the GUI thread
+    BodyPositionItem::LengthUnit lengthUnit;
+    BodyPositionItem::AngleUnit angleUnit;
+    BodyPositionItem::readUnitOptions(item->fileOptions(), lengthUnit, angleUnit);
+    BodyPositionWriter writer;
+    item->putBodyPosition(writer, lengthUnit, angleUnit);
+    writer.takeText(job.text);
+
+    auto& info = savingItems[item];
+    info.item = item;
+    info.latestJobId = job.id;
+
+    {
+        lock_guard<mutex> lock(jobMutex);
+        jobs.push_back(std::move(job));
+        ++numUnfinishedJobs;
+    }
+    if(!workerThread.joinable()){
+        workerThread = thread([this](){ run(); });
+    } else {
+        jobCondition.notify_one();
+    }
+}
+
+
+void BodyPositionFileSaver::Impl::run()
+{
+    unique_lock<mutex> lock(jobMutex);
+    while(true){
+        jobCondition.wait(lock, [this](){ return isWorkerStopping || !jobs.empty(); });
+        if(jobs.empty()){
+            break;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        string error;
+        {
+            BodyPositionTrace::Span span("BodyPositionFileSaver::writeFileAtomically");
+            writeFileAtomically(job.filename, job.text.data(), job.text.size(), error);
+        }
+        auto item = job.item;
+        auto id = job.id;
+        auto filename = job.filename;
+        weak_ptr<bool> alive = liveness;
+        callLater(
+            [this, alive, item, id, filename, error](){
+                if(alive.lock()){
+                    onJobFinished(item, id, filename, error);
+                }
+            });
+
+        lock.lock();
+        --numUnfinishedJobs;
+        completionCondition.notify_all();
+    }
+}
+
+
+void BodyPositionFileSaver::Impl::onJobFinished
+(BodyPositionItem* item, int jobId, const string& filename, const string& error)
+{
+    auto p = savingItems.find(item);
+    if(p == savingItems.end() || p->second.latestJobId != jobId){
+        return;
+    }
+    BodyPositionItemPtr itemPtr = p->second.item;
+    savingItems.erase(p);
+
+    if(!error.empty()){
+        mvout() << format("Failed to save \"{0}\": {1}", filename, error) << endl;
+
+    } else if(!dirtyItems.count(item) && item->filePath() == filename){
+        MappingPtr options;
+        if(auto orgOptions = item->fileOptions()){
+            options = orgOptions->cloneMapping();
+        }
+        item->updateFileInformation(filename, item->fileFormat(), options);
+    }
+}
+
+
+bool BodyPositionFileSaver::isSaving(BodyPositionItem* item) const
+{
+    return impl && (impl->dirtyItems.count(item) || impl->savingItems.count(item));
+}
+
+
+void BodyPositionFileSaver::finishPendingSaves()
+{
+    BodyPositionTrace::Span span("BodyPositionFileSaver::finishPendingSaves");
+    if(!impl){
+        return;
+    }
+    impl->timer.stop();
+    impl->saveDirtyItems();
+    unique_lock<mutex> lock(impl->jobMutex);
+    impl->completionCondition.wait(lock, [this](){ return impl->numUnfinishedJobs == 0; });
+}
+
+
+// The timer must be destroyed before the application object
+void BodyPositionFileSaver::finalize()
+{
+    finishPendingSaves();
+    isEnabled_ = false;
+    delete impl;
+    impl = nullptr;
+}
+
+
+bool BodyPositionFileSaver::writeFileAtomically
+(const std::string& filename, const char* data, size_t size, std::string& out_error)
+{
+    string tmpFilename = filename + ".tmp";
+    auto fp = std::fopen(tmpFilename.c_str(), "wb");
+    if(!fp){
+        out_error = std::strerror(errno);
+        return false;
+    }
+    bool written = (std::fwrite(data, 1, size, fp) == size) && (std::fflush(fp) == 0);
+    if(written){
+#ifdef _WIN32
+        written = (_commit(_fileno(fp)) == 0);
+#else
+        written = (fsync(fileno(fp)) == 0);
+#endif
+    }
+    if(!written){
+        out_error = std::strerror(errno);
+    }
+    if(std::fclose(fp) != 0 && written){
+        out_error = std::strerror(errno);
+        written = false;
+    }
+    if(!written){
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+
+    stdx::error_code ec;
+    stdx::filesystem::rename(tmpFilename, filename, ec);
+    if(ec){
+        out_error = ec.message();
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_FILE_SAVER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_FILE_SAVER_H
+
+#include "BodyPositionItem.h"
+#include <string>
+
+/**
+   This class saves the files of body position items on a worker thread when the project is
+   stored. Each file is written to a temporary file first and then renamed to the target file.
+
+   The files of the items updated by edits are only saved automatically if the auto saving is
+   enabled, so the edits can be discarded by not saving the project by default.
+*/
+class BodyPositionFileSaver
+{
+public:
+    static BodyPositionFileSaver* instance();
+
+    void setEnabled(bool on);
+    bool isEnabled() const { return isEnabled_; }
+    void setAutoSavingEnabled(bool on);
+    bool isAutoSavingEnabled() const { return isAutoSavingEnabled_; }
+
+    // The file is saved after a series of updates of the item has settled down if auto saving is enabled
+    void requestSave(BodyPositionItem* item);
+    void requestSaveNow(BodyPositionItem* item);
+    // The pending save of an item removed from the project is canceled
+    void cancelSave(BodyPositionItem* item);
+    void finishPendingSaves();
+    bool isSaving(BodyPositionItem* item) const;
+
+    // The pending saves are finished, and the timer and the worker thread are released
+    void finalize();
+
+    static bool writeFileAtomically(
+        const std::string& filename, const char* data, size_t size, std::string& out_error);
+
+private:
+    BodyPositionFileSaver();
+    ~BodyPositionFileSaver();
+
+    class Impl;
+    Impl* impl;
+    bool isEnabled_;
+    bool isAutoSavingEnabled_;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_FILE_SAVER_H
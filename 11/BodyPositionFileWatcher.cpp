@@ -0,0 +1,330 @@
+#include "BodyPositionFileWatcher.h"
+#include "BodyPositionFileSaver.h"
+#include "BodyPositionWriter.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/Timer>
+#include <cnoid/MessageView>
+#include <cnoid/stdx/filesystem>
+#include <fmt/format.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#ifdef __linux__
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+namespace filesystem = cnoid::stdx::filesystem;
+
+namespace {
+
+const int ReloadDelay = 300; // msec
+
+/**
+   The file is compared with the text that the item would write instead of the modification
+   time, whose resolution may be a second. The file written by the item itself is not reloaded.
+*/
+bool hasContentOf(BodyPositionItem* item, const filesystem::path& path)
+{
+    ifstream ifs(path.string(), ios::binary);
+    if(!ifs){
+        return false;
+    }
+    string content((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    BodyPositionItem::LengthUnit lengthUnit;
+    BodyPositionItem::AngleUnit angleUnit;
+    BodyPositionItem::readUnitOptions(item->fileOptions(), lengthUnit, angleUnit);
+    BodyPositionWriter writer;
+    item->putBodyPosition(writer, lengthUnit, angleUnit);
+    vector<char> text;
+    writer.takeText(text);
+    return content.size() == text.size() && std::equal(text.begin(), text.end(), content.begin());
+}
+
+}
+
+class BodyPositionFileWatcher::Impl
+{
+public:
+    set<BodyPositionItem*> items;
+    Timer reloadTimer;
+    set<string> updatedFiles;
+    // All the files are checked when the events have been lost by the overflow of the queue
+    bool isEventQueueOverflowed;
+#ifdef __linux__
+    int inotifyFd;
+    QSocketNotifier* notifier;
+    map<string, int> directoryToWatchId;
+    map<int, string> watchIdToDirectory;
+#endif
+
+    Impl();
+    ~Impl();
+    bool isAvailable() const;
+    bool isStarted() const;
+    bool start();
+    void stop();
+    void watchDirectoryOf(BodyPositionItem* item);
+    void readEvents();
+    void reloadUpdatedFiles();
+};
+
+
+BodyPositionFileWatcher* BodyPositionFileWatcher::instance()
+{
+    static BodyPositionFileWatcher watcher;
+    return &watcher;
+}
+
+
+BodyPositionFileWatcher::BodyPositionFileWatcher()
+{
+    impl = new Impl;
+    isEnabled_ = false;
+    setEnabled(true);
+}
+
+
+BodyPositionFileWatcher::Impl::Impl()
+{
+    reloadTimer.setSingleShot(true);
+    reloadTimer.setInterval(ReloadDelay);
+    reloadTimer.sigTimeout().connect([this](){ reloadUpdatedFiles(); });
+    isEventQueueOverflowed = false;
+#ifdef __linux__
+    inotifyFd = -1;
+    notifier = nullptr;
+#endif
+}
+
+
+BodyPositionFileWatcher::~BodyPositionFileWatcher()
+{
+    delete impl;
+}
+
+
+BodyPositionFileWatcher::Impl::~Impl()
+{
+    stop();
+}
+
+
+/**
+   The watching is started when the first item is added so that no watch is created
+   at the startup of Choreonoid.
+*/
+void BodyPositionFileWatcher::setEnabled(bool on)
+{
+    if(on != isEnabled_ && impl){
+        if(on){
+            isEnabled_ = impl->items.empty() ? impl->isAvailable() : impl->start();
+        } else {
+            impl->stop();
+            isEnabled_ = false;
+        }
+    }
+}
+
+
+bool BodyPositionFileWatcher::Impl::isAvailable() const
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool BodyPositionFileWatcher::Impl::isStarted() const
+{
+#ifdef __linux__
+    return inotifyFd >= 0;
+#else
+    return false;
+#endif
+}
+
+
+bool BodyPositionFileWatcher::Impl::start()
+{
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotifyFd < 0){
+        return false;
+    }
+    notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read);
+    QObject::connect(notifier, &QSocketNotifier::activated, [this](){ readEvents(); });
+    for(auto& item : items){
+        watchDirectoryOf(item);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void BodyPositionFileWatcher::Impl::stop()
+{
+    reloadTimer.stop();
+    updatedFiles.clear();
+    isEventQueueOverflowed = false;
+#ifdef __linux__
+    if(inotifyFd >= 0){
+        delete notifier;
+        notifier = nullptr;
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        directoryToWatchId.clear();
+        watchIdToDirectory.clear();
+    }
+#endif
+}
+
+
+void BodyPositionFileWatcher::addItem(BodyPositionItem* item)
+{
+    if(!impl){
+        return;
+    }
+    impl->items.insert(item);
+    if(isEnabled_){
+        if(impl->isStarted()){
+            impl->watchDirectoryOf(item);
+        } else {
+            isEnabled_ = impl->start();
+        }
+    }
+}
+
+
+void BodyPositionFileWatcher::removeItem(BodyPositionItem* item)
+{
+    // The watch of the directory is kept because it is cheap and is likely to be used again
+    if(impl){
+        impl->items.erase(item);
+    }
+}
+
+
+// The timer and the socket notifier must be destroyed before the application object
+void BodyPositionFileWatcher::finalize()
+{
+    isEnabled_ = false;
+    delete impl;
+    impl = nullptr;
+}
+
+
+void BodyPositionFileWatcher::Impl::watchDirectoryOf(BodyPositionItem* item)
+{
+#ifdef __linux__
+    if(item->filePath().empty()){
+        return;
+    }
+    string directory = filesystem::path(item->filePath()).parent_path().string();
+    if(directoryToWatchId.find(directory) == directoryToWatchId.end()){
+        // A file written with the write-and-rename method is detected with IN_MOVED_TO
+        int id = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(id >= 0){
+            directoryToWatchId[directory] = id;
+            watchIdToDirectory[id] = directory;
+        }
+    }
+#endif
+}
+
+
+void BodyPositionFileWatcher::Impl::readEvents()
+{
+#ifdef __linux__
+    alignas(inotify_event) char buf[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    bool isUpdated = false;
+    while(true){
+        ssize_t size = ::read(inotifyFd, buf, sizeof(buf));
+        if(size <= 0){
+            break;
+        }
+        for(char* p = buf; p < buf + size; ){
+            auto event = reinterpret_cast<inotify_event*>(p);
+            if(event->mask & IN_Q_OVERFLOW){
+                isEventQueueOverflowed = true;
+                isUpdated = true;
+            } else if(event->len > 0){
+                auto q = watchIdToDirectory.find(event->wd);
+                if(q != watchIdToDirectory.end()){
+                    updatedFiles.insert(q->second + "/" + event->name);
+                    isUpdated = true;
+                }
+            }
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+    if(isUpdated){
+        reloadTimer.start();
+    }
+#endif
+}
+
+
+void BodyPositionFileWatcher::Impl::reloadUpdatedFiles()
+{
+    BodyPositionTrace::Span span("BodyPositionFileWatcher::reloadUpdatedFiles");
+    auto saver = BodyPositionFileSaver::instance();
+    int numReloaded = 0;
+    if(isEventQueueOverflowed){
+        mvout() << "Some file change events have been lost, so all the body position files are checked."
+                << endl;
+    }
+
+    for(auto& item : items){
+        if(item->filePath().empty()){
+            continue;
+        }
+        filesystem::path path(item->filePath());
+        if(!isEventQueueOverflowed &&
+           !updatedFiles.count(path.parent_path().string() + "/" + path.filename().string())){
+            continue;
+        }
+        if(!filesystem::exists(path) || saver->isSaving(item)){
+            continue;
+        }
+        // The file of a pending item is not compared because it has not been read yet
+        if(!item->isLoadPending() && hasContentOf(item, path)){
+            continue;
+        }
+        if(!item->isConsistentWithFile()){
+            mvout()
+                << format("\"{0}\" has been updated by another program, but it is not reloaded "
+                          "because {1} has unsaved changes.", item->filePath(), item->name())
+                << endl;
+            continue;
+        }
+        if(item->reloadBodyPositionFile(mvout())){
+            ++numReloaded;
+        }
+    }
+    updatedFiles.clear();
+    isEventQueueOverflowed = false;
+
+    // A directory may have been changed by saving the item as another file
+    for(auto& item : items){
+        watchDirectoryOf(item);
+    }
+
+    if(numReloaded > 0){
+        mvout() << format("{0} body position file(s) updated by another program have been reloaded.",
+                          numReloaded) << endl;
+    }
+}
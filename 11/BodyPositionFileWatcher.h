@@ -0,0 +1,33 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_FILE_WATCHER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_FILE_WATCHER_H
+
+#include "BodyPositionItem.h"
+
+/**
+   This class watches the files of the body position items in the project and reloads
+   the files updated by other programs. The updates are collected until they settle down,
+   and then the items are reloaded together. The watching is only available on Linux.
+*/
+class BodyPositionFileWatcher
+{
+public:
+    static BodyPositionFileWatcher* instance();
+
+    void setEnabled(bool on);
+    bool isEnabled() const { return isEnabled_; }
+    void addItem(BodyPositionItem* item);
+    void removeItem(BodyPositionItem* item);
+
+    // The watching is stopped, and the timer and the socket notifier are released
+    void finalize();
+
+private:
+    BodyPositionFileWatcher();
+    ~BodyPositionFileWatcher();
+
+    class Impl;
+    Impl* impl;
+    bool isEnabled_;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_FILE_WATCHER_H
@@ -0,0 +1,88 @@
+#include "BodyPositionFormat.h"
+
+using namespace std;
+
+namespace {
+
+const char* flagColorSymbols[] = { "Red", "Green", "Blue" };
+const double DefaultFlagHeightInMeter = 1.8;
+const double Pi = 3.14159265358979323846;
+
+}
+
+double BodyPositionFormat::defaultFlagHeight(LengthUnit unit)
+{
+    return DefaultFlagHeightInMeter * lengthRatio(Meter, unit);
+}
+
+double BodyPositionFormat::lengthRatio(LengthUnit from, LengthUnit to)
+{
+    if(from == Meter && to == Millimeter){
+        return 1000.0;
+    } else if(from == Millimeter && to == Meter){
+        return 1.0 / 1000.0;
+    }
+    return 1.0;
+}
+
+double BodyPositionFormat::angleRatio(AngleUnit from, AngleUnit to)
+{
+    if(from == Degree && to == Radian){
+        return Pi / 180.0;
+    } else if(from == Radian && to == Degree){
+        return 180.0 / Pi;
+    }
+    return 1.0;
+}
+
+const char* BodyPositionFormat::lengthUnitSymbol(LengthUnit unit)
+{
+    return (unit == Millimeter) ? "millimeter" : "meter";
+}
+
+const char* BodyPositionFormat::angleUnitSymbol(AngleUnit unit)
+{
+    return (unit == Radian) ? "radian" : "degree";
+}
+
+bool BodyPositionFormat::readLengthUnit(const std::string& symbol, LengthUnit& out_unit)
+{
+    if(symbol == "meter"){
+        out_unit = Meter;
+    } else if(symbol == "millimeter"){
+        out_unit = Millimeter;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool BodyPositionFormat::readAngleUnit(const std::string& symbol, AngleUnit& out_unit)
+{
+    if(symbol == "degree"){
+        out_unit = Degree;
+    } else if(symbol == "radian"){
+        out_unit = Radian;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* BodyPositionFormat::flagColorSymbol(int colorId)
+{
+    if(colorId < 0 || colorId >= NumFlagColors){
+        return nullptr;
+    }
+    return flagColorSymbols[colorId];
+}
+
+int BodyPositionFormat::findFlagColor(const std::string& symbol)
+{
+    for(int i=0; i < NumFlagColors; ++i){
+        if(symbol == flagColorSymbols[i]){
+            return i;
+        }
+    }
+    return -1;
+}
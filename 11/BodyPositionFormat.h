@@ -0,0 +1,36 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_FORMAT_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_FORMAT_H
+
+#include <string>
+
+/**
+   This class defines the units, the flag colors and the default values of the body position
+   files. It is shared by BodyPositionItem and the command line tool, which does not depend on
+   the GUI libraries.
+*/
+class BodyPositionFormat
+{
+public:
+    enum LengthUnit { Meter, Millimeter };
+    enum AngleUnit { Degree, Radian };
+    enum ColorId { Red, Green, Blue, NumFlagColors };
+    static constexpr ColorId DefaultFlagColor = Red;
+
+    // The default flag height is 1.8 m
+    static double defaultFlagHeight(LengthUnit unit = Meter);
+
+    // The values in the first unit are converted to the second unit by multiplying the ratio
+    static double lengthRatio(LengthUnit from, LengthUnit to);
+    static double angleRatio(AngleUnit from, AngleUnit to);
+
+    static const char* lengthUnitSymbol(LengthUnit unit);
+    static const char* angleUnitSymbol(AngleUnit unit);
+    static bool readLengthUnit(const std::string& symbol, LengthUnit& out_unit);
+    static bool readAngleUnit(const std::string& symbol, AngleUnit& out_unit);
+
+    static const char* flagColorSymbol(int colorId);
+    // Returns -1 if the symbol is not a flag color
+    static int findFlagColor(const std::string& symbol);
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_FORMAT_H
@@ -0,0 +1,418 @@
+#include "BodyPositionImporter.h"
+#include "BodyPositionParser.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/FolderItem>
+#include <cnoid/RootItem>
+#include <cnoid/BodyItem>
+#include <cnoid/FileDialog>
+#include <cnoid/MessageView>
+#include <cnoid/EigenUtil>
+#include <cnoid/stdx/filesystem>
+#include <QBoxLayout>
+#include <QLabel>
+#include <QComboBox>
+#include <fmt/format.h>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <cmath>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+
+namespace {
+
+const char* ColumnarFileSignature = "BPOSCOL1";
+
+enum FieldType { IgnoredField = -1, NameField = -2, FlagColorField = -3 };
+
+const char* numericColumnNames[] = { "x", "y", "z", "roll", "pitch", "yaw", "flag_height" };
+
+bool isLittleEndian()
+{
+    const uint16_t value = 1;
+    return *reinterpret_cast<const unsigned char*>(&value) == 1;
+}
+
+// The values of a columnar file are converted from little endian in place
+template<class T>
+void convertFromLittleEndian(T* values, size_t size)
+{
+    if(!isLittleEndian()){
+        for(size_t i=0; i < size; ++i){
+            auto bytes = reinterpret_cast<unsigned char*>(&values[i]);
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+    }
+}
+
+string toLower(string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){ return std::tolower(c); });
+    return s;
+}
+
+string trim(const char* begin, const char* end)
+{
+    while(begin < end && std::isspace(static_cast<unsigned char>(*begin))){
+        ++begin;
+    }
+    while(end > begin && std::isspace(static_cast<unsigned char>(*(end - 1)))){
+        --end;
+    }
+    return string(begin, end);
+}
+
+bool readColorId(const string& text, unsigned char& out_id)
+{
+    string color = toLower(text);
+    if(color == "red" || color == "0"){
+        out_id = BodyPositionItem::Red;
+    } else if(color == "green" || color == "1"){
+        out_id = BodyPositionItem::Green;
+    } else if(color == "blue" || color == "2"){
+        out_id = BodyPositionItem::Blue;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}
+
+BodyPositionImporter::BodyPositionImporter()
+{
+    lengthUnit = BodyPositionItem::Meter;
+    angleUnit = BodyPositionItem::Degree;
+}
+
+void BodyPositionImporter::clear(int size)
+{
+    for(auto& column : columns){
+        column.clear();
+        column.reserve(size);
+    }
+    flagColors.clear();
+    flagColors.reserve(size);
+    names.clear();
+}
+
+bool BodyPositionImporter::load(const std::string& filename, std::ostream& os)
+{
+    BodyPositionTrace::Span span("BodyPositionImporter::load");
+    if(toLower(stdx::filesystem::path(filename).extension().string()) == ".csv"){
+        return loadCsvFile(filename, os);
+    }
+    return loadColumnarFile(filename, os);
+}
+
+bool BodyPositionImporter::loadCsvFile(const std::string& filename, std::ostream& os)
+{
+    ifstream ifs(filename, ios::in | ios::binary);
+    if(!ifs){
+        os << format("\"{0}\" cannot be opened.", filename) << endl;
+        return false;
+    }
+    string text((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    clear(std::count(text.begin(), text.end(), '\n') + 1);
+
+    vector<int> fields;
+    bool hasNames = false;
+    bool hasFlagHeights = false;
+    const char* p = text.c_str();
+    const char* end = p + text.size();
+    int lineNumber = 0;
+
+    while(p < end){
+        ++lineNumber;
+        auto lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if(!lineEnd){
+            lineEnd = end;
+        }
+        auto next = (lineEnd < end) ? lineEnd + 1 : end;
+        if(trim(p, lineEnd).empty()){
+            p = next;
+            continue;
+        }
+
+        if(fields.empty()){
+            auto q = p;
+            while(q < lineEnd && std::isspace(static_cast<unsigned char>(*q))){
+                ++q;
+            }
+            if(std::isalpha(static_cast<unsigned char>(*q))){
+                // Header line
+                while(p <= lineEnd){
+                    auto fieldEnd = static_cast<const char*>(std::memchr(p, ',', lineEnd - p));
+                    if(!fieldEnd){
+                        fieldEnd = lineEnd;
+                    }
+                    string name = toLower(trim(p, fieldEnd));
+                    int field = IgnoredField;
+                    if(name == "name"){
+                        field = NameField;
+                        hasNames = true;
+                    } else if(name == "flag_color"){
+                        field = FlagColorField;
+                    } else {
+                        for(int i=0; i < NumNumericColumns; ++i){
+                            if(name == numericColumnNames[i]){
+                                field = i;
+                                if(i == FlagHeight){
+                                    hasFlagHeights = true;
+                                }
+                            }
+                        }
+                    }
+                    fields.push_back(field);
+                    p = fieldEnd + 1;
+                }
+                p = next;
+                continue;
+            } else {
+                fields = { X, Y, Z, Roll, Pitch, Yaw, FlagHeight, FlagColorField };
+                hasFlagHeights = true;
+            }
+        }
+
+        int index = numPositions();
+        for(auto& column : columns){
+            column.push_back(0.0);
+        }
+        flagColors.push_back(BodyPositionItem::Red);
+        if(hasNames){
+            names.emplace_back();
+        }
+        bool hasFlagHeight = false;
+
+        for(size_t i=0; i < fields.size() && p <= lineEnd; ++i){
+            auto fieldEnd = static_cast<const char*>(std::memchr(p, ',', lineEnd - p));
+            if(!fieldEnd){
+                fieldEnd = lineEnd;
+            }
+            int field = fields[i];
+            if(field >= 0){
+                double value;
+                const char* numberBegin = p;
+                while(numberBegin < fieldEnd && (*numberBegin == ' ' || *numberBegin == '\t')){
+                    ++numberBegin;
+                }
+                auto numberEnd = BodyPositionParser::readNumber(numberBegin, fieldEnd, value);
+                if(!numberEnd || !trim(numberEnd, fieldEnd).empty()){
+                    os << format("{0}:{1}: \"{2}\" is not a number.",
+                                 filename, lineNumber, trim(p, fieldEnd)) << endl;
+                    return false;
+                }
+                columns[field][index] = value;
+                if(field == FlagHeight){
+                    hasFlagHeight = true;
+                }
+            } else if(field == FlagColorField){
+                if(!readColorId(trim(p, fieldEnd), flagColors[index])){
+                    os << format("{0}:{1}: \"{2}\" is not a flag color.",
+                                 filename, lineNumber, trim(p, fieldEnd)) << endl;
+                    return false;
+                }
+            } else if(field == NameField){
+                names[index] = trim(p, fieldEnd);
+            }
+            p = fieldEnd + 1;
+        }
+        if(!hasFlagHeight){
+            columns[FlagHeight][index] = -1.0;
+        }
+        p = next;
+    }
+
+    if(!hasFlagHeights){
+        std::fill(columns[FlagHeight].begin(), columns[FlagHeight].end(), -1.0);
+    }
+    convertUnits();
+    return true;
+}
+
+bool BodyPositionImporter::loadColumnarFile(const std::string& filename, std::ostream& os)
+{
+    auto fp = std::fopen(filename.c_str(), "rb");
+    if(!fp){
+        os << format("\"{0}\" cannot be opened.", filename) << endl;
+        return false;
+    }
+    bool loaded = false;
+    char signature[8];
+    uint32_t size = 0;
+    bool hasSize = false;
+    // The size is checked with the file size before the columns are allocated
+    stdx::error_code ec;
+    uintmax_t fileSize = stdx::filesystem::file_size(filename, ec);
+    bool hasSignature =
+        std::fread(signature, 1, 8, fp) == 8 && std::memcmp(signature, ColumnarFileSignature, 8) == 0;
+    if(hasSignature && std::fread(&size, sizeof(size), 1, fp) == 1){
+        convertFromLittleEndian(&size, 1);
+        hasSize = true;
+    }
+    if(!hasSignature){
+        os << format("\"{0}\" is not a columnar body position file.", filename) << endl;
+    } else if(!hasSize || ec ||
+              fileSize != 8 + sizeof(size) + uintmax_t(size) * (NumNumericColumns * sizeof(double) + 1)){
+        os << format("\"{0}\" is broken.", filename) << endl;
+    } else {
+        clear();
+        loaded = true;
+        for(auto& column : columns){
+            column.resize(size);
+            if(std::fread(column.data(), sizeof(double), size, fp) != size){
+                loaded = false;
+                break;
+            }
+            convertFromLittleEndian(column.data(), size);
+        }
+        if(loaded){
+            flagColors.resize(size);
+            loaded = (std::fread(flagColors.data(), 1, size, fp) == size);
+        }
+        if(!loaded){
+            os << format("\"{0}\" is broken.", filename) << endl;
+            clear();
+        } else {
+            for(int i=0; i < NumNumericColumns && loaded; ++i){
+                for(uint32_t j=0; j < size; ++j){
+                    if(!std::isfinite(columns[i][j])){
+                        os << format("\"{0}\": The {1} value of position {2} is not a finite number.",
+                                     filename, numericColumnNames[i], j + 1) << endl;
+                        clear();
+                        loaded = false;
+                        break;
+                    }
+                }
+            }
+            for(uint32_t i=0; i < size && loaded; ++i){
+                if(flagColors[i] > BodyPositionItem::Blue){
+                    os << format("\"{0}\": The flag color {1} of position {2} is not valid.",
+                                 filename, static_cast<int>(flagColors[i]), i + 1) << endl;
+                    clear();
+                    loaded = false;
+                }
+            }
+        }
+    }
+    std::fclose(fp);
+
+    if(loaded){
+        convertUnits();
+    }
+    return loaded;
+}
+
+// Each column is converted with a simple loop so that the compiler can vectorize it
+void BodyPositionImporter::convertUnits()
+{
+    if(lengthUnit == BodyPositionItem::Millimeter){
+        for(int i : { X, Y, Z, FlagHeight }){
+            for(auto& value : columns[i]){
+                value /= 1000.0;
+            }
+        }
+    }
+    if(angleUnit == BodyPositionItem::Degree){
+        for(int i : { Roll, Pitch, Yaw }){
+            for(auto& value : columns[i]){
+                value = radian(value);
+            }
+        }
+    }
+}
+
+bool BodyPositionImporter::createItems(cnoid::Item* parentItem, const std::string& folderName)
+{
+    BodyPositionTrace::Span span("BodyPositionImporter::createItems");
+    int n = numPositions();
+    if(n == 0){
+        return false;
+    }
+    
+    // The items are not connected to the root item here, so no signal is emitted for them
+    FolderItemPtr folderItem = new FolderItem;
+    folderItem->setName(folderName);
+    for(int i=0; i < n; ++i){
+        BodyPositionItemPtr item = new BodyPositionItem;
+        if(i < (int)names.size() && !names[i].empty()){
+            item->setName(names[i]);
+        } else {
+            item->setName(format("{0}-{1}", folderName, i + 1));
+        }
+        Isometry3 T;
+        T.linear() = rotFromRpy(columns[Roll][i], columns[Pitch][i], columns[Yaw][i]);
+        T.translation() << columns[X][i], columns[Y][i], columns[Z][i];
+        item->setPosition(T);
+        if(columns[FlagHeight][i] > 0.0){
+            item->setFlagHeight(columns[FlagHeight][i]);
+        }
+        item->setFlagColor(flagColors[i]);
+        folderItem->addChildItem(item);
+    }
+
+    BodyPositionItem::beginItemsInProjectChangeBatch();
+    parentItem->addChildItem(folderItem);
+    BodyPositionItem::endItemsInProjectChangeBatch();
+
+    return true;
+}
+
+void BodyPositionImporter::importWithDialog()
+{
+    auto bodyItems = RootItem::instance()->selectedItems<BodyItem>();
+    if(bodyItems.size() != 1){
+        showWarningDialog("Select a body item to import body positions into.");
+        return;
+    }
+    BodyItem* bodyItem = bodyItems.front();
+
+    FileDialog dialog;
+    dialog.setWindowTitle("Import Body Positions");
+    dialog.setFileMode(QFileDialog::ExistingFile);
+    dialog.setViewMode(QFileDialog::List);
+    dialog.setLabelText(QFileDialog::Accept, "Import");
+    dialog.setNameFilters({ "CSV files (*.csv)", "Columnar body position files (*.posc)", "Any files (*)" });
+    dialog.updatePresetDirectories();
+
+    auto panel = new QWidget;
+    auto hbox = new QHBoxLayout;
+    panel->setLayout(hbox);
+    hbox->addWidget(new QLabel("Length unit"));
+    auto lengthUnitCombo = new QComboBox;
+    lengthUnitCombo->addItem("Meter");
+    lengthUnitCombo->addItem("Millimeter");
+    hbox->addWidget(lengthUnitCombo);
+    hbox->addWidget(new QLabel("Angle unit"));
+    auto angleUnitCombo = new QComboBox;
+    angleUnitCombo->addItem("Degree");
+    angleUnitCombo->addItem("Radian");
+    hbox->addWidget(angleUnitCombo);
+    hbox->addStretch();
+    dialog.insertOptionPanel(panel);
+
+    if(dialog.exec() != QDialog::Accepted || dialog.selectedFiles().isEmpty()){
+        return;
+    }
+    string filename = dialog.selectedFiles().front().toStdString();
+
+    BodyPositionImporter importer;
+    importer.setLengthUnit(
+        lengthUnitCombo->currentIndex() == 0 ? BodyPositionItem::Meter : BodyPositionItem::Millimeter);
+    importer.setAngleUnit(
+        angleUnitCombo->currentIndex() == 0 ? BodyPositionItem::Degree : BodyPositionItem::Radian);
+
+    if(importer.load(filename, mvout())){
+        string name = stdx::filesystem::path(filename).stem().string();
+        if(importer.createItems(bodyItem, name)){
+            mvout() << format("{0} body positions have been imported from \"{1}\" to {2}.",
+                              importer.numPositions(), filename, bodyItem->name()) << endl;
+        }
+    }
+}
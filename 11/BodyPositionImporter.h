@@ -0,0 +1,54 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_IMPORTER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_IMPORTER_H
+
+#include "BodyPositionItem.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+/**
+   This class imports many body positions from a CSV file or a columnar binary file
+   and creates the corresponding items at once.
+
+   The first line of a CSV file may be a header specifying the column names, which are
+   "name", "x", "y", "z", "roll", "pitch", "yaw", "flag_height" and "flag_color".
+   Without the header, the columns are x, y, z, roll, pitch, yaw, flag_height and flag_color.
+
+   A columnar binary file consists of the "BPOSCOL1" signature, the number of positions as
+   a 32-bit unsigned integer, the x, y, z, roll, pitch, yaw and flag_height columns of
+   64-bit floating point values and the flag_color column of 8-bit color ids.
+   All the values are stored in little endian and are converted to the byte order of the host
+   when they are loaded. The file is rejected if it contains a value that is not finite.
+*/
+class BodyPositionImporter
+{
+public:
+    BodyPositionImporter();
+
+    void setLengthUnit(BodyPositionItem::LengthUnit unit) { lengthUnit = unit; }
+    void setAngleUnit(BodyPositionItem::AngleUnit unit) { angleUnit = unit; }
+
+    bool load(const std::string& filename, std::ostream& os);
+    bool loadCsvFile(const std::string& filename, std::ostream& os);
+    bool loadColumnarFile(const std::string& filename, std::ostream& os);
+    int numPositions() const { return static_cast<int>(columns[X].size()); }
+
+    // The items are added to the parent item with a folder item in a single insertion
+    bool createItems(cnoid::Item* parentItem, const std::string& folderName);
+
+    static void importWithDialog();
+
+private:
+    enum ColumnId { X, Y, Z, Roll, Pitch, Yaw, FlagHeight, NumNumericColumns };
+
+    void clear(int size = 0);
+    void convertUnits();
+
+    BodyPositionItem::LengthUnit lengthUnit;
+    BodyPositionItem::AngleUnit angleUnit;
+    std::vector<double> columns[NumNumericColumns];
+    std::vector<unsigned char> flagColors;
+    std::vector<std::string> names;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_IMPORTER_H
@@ -1,36 +1,128 @@
 #include "BodyPositionItem.h"
+#include "BodyPositionParser.h"
+#include "BodyPositionWriter.h"
+#include "BodyPositionFileSaver.h"
+#include "BodyPositionFileWatcher.h"
+#include "BodyPositionTrace.h"
 #include <cnoid/BodyItem>
+#include <cnoid/RootItem>
 #include <cnoid/MeshGenerator>
 #include <cnoid/EigenUtil>
 #include <cnoid/PutPropertyFunction>
+#include <cnoid/Selection>
 #include <cnoid/Archive>
 #include <cnoid/EigenArchive>
-#include <cnoid/YAMLReader>
-#include <cnoid/YAMLWriter>
+#include <cnoid/LazyCaller>
+#include <cnoid/stdx/filesystem>
 #include <fmt/format.h>
+#include <unordered_map>
+#include <sstream>
+#include <algorithm>
 
 using namespace std;
 using namespace fmt;
 using namespace cnoid;
 
+namespace {
+
+bool isLazyLoadingEnabled_ = true;
+Signal<void(BodyPositionItem* item)> sigPendingFileLoaded_;
+vector<BodyPositionItemPtr> loadedPendingItems;
+string pendingLoadMessages;
+bool isPendingLoadNotificationRequested = false;
+
+void notifyPendingFileLoads()
+{
+    isPendingLoadNotificationRequested = false;
+    vector<BodyPositionItemPtr> items;
+    items.swap(loadedPendingItems);
+    string messages;
+    messages.swap(pendingLoadMessages);
+    if(!messages.empty()){
+        mvout() << messages << flush;
+    }
+    for(auto& item : items){
+        sigPendingFileLoaded_(item);
+    }
+}
+
+/**
+   The shapes of the flag are created once and shared by the scenes of all the items.
+   The pole is a cylinder of unit height that is scaled to the flag height.
+*/
+struct FlagShapes
+{
+    SgShapePtr pole;
+    SgShapePtr ornament;
+    SgShapePtr banners[BodyPositionFormat::NumFlagColors];
+
+    FlagShapes()
+    {
+        MeshGenerator meshGenerator;
+        
+        pole = new SgShape;
+        pole->setMesh(meshGenerator.generateCylinder(0.01, 1.0));
+        pole->getOrCreateMaterial()->setDiffuseColor(Vector3f(0.7f, 0.7f, 0.7f));
+
+        ornament = new SgShape;
+        ornament->setMesh(meshGenerator.generateSphere(0.02));
+        ornament->getOrCreateMaterial()->setDiffuseColor(Vector3f(1.0f, 1.0f, 0.0f));
+
+        auto bannerMesh = meshGenerator.generateBox(Vector3(0.002, 0.3, 0.2));
+        const Vector3f colors[] = { Vector3f(1.0f, 0.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f), Vector3f(0.0f, 0.0f, 1.0f) };
+        for(int i=0; i < BodyPositionFormat::NumFlagColors; ++i){
+            banners[i] = new SgShape;
+            banners[i]->setMesh(bannerMesh);
+            banners[i]->getOrCreateMaterial()->setDiffuseColor(colors[i]);
+        }
+    }
+};
+
+FlagShapes& flagShapes()
+{
+    static FlagShapes shapes;
+    return shapes;
+}
+
+}
+
+void BodyPositionItem::setLazyLoadingEnabled(bool on)
+{
+    isLazyLoadingEnabled_ = on;
+}
+
+bool BodyPositionItem::isLazyLoadingEnabled()
+{
+    return isLazyLoadingEnabled_;
+}
+
+SignalProxy<void(BodyPositionItem* item)> BodyPositionItem::sigPendingFileLoaded()
+{
+    return sigPendingFileLoaded_;
+}
+
 BodyPositionItem::BodyPositionItem()
 {
     bodyItem = nullptr;
-    position_.setIdentity();
-    flagColorSelection.setSymbol(Red, "Red");
-    flagColorSelection.setSymbol(Green, "Green");
-    flagColorSelection.setSymbol(Blue, "Blue");
-    flagColorSelection.select(Red);
-    flagHeight_ = 1.8;
+    isLoadPending_ = false;
+    isFlagPreviewActive_ = false;
+    translation_.setZero();
+    rotation_.setIdentity();
+    flagColor_ = DefaultFlagColor;
+    flagHeight_ = defaultFlagHeight();
 }
     
 BodyPositionItem::BodyPositionItem(const BodyPositionItem& org)
     : Item(org)
 {
+    org.resolvePendingLoad();
     bodyItem = nullptr;
-    position_ = org.position_;
+    isLoadPending_ = false;
+    isFlagPreviewActive_ = false;
+    translation_ = org.translation_;
+    rotation_ = org.rotation_;
     flagHeight_ = org.flagHeight_;
-    flagColorSelection = org.flagColorSelection;
+    flagColor_ = org.flagColor_;
 }
     
 Item* BodyPositionItem::doDuplicate() const
@@ -40,13 +132,44 @@ Item* BodyPositionItem::doDuplicate() const
 
 void BodyPositionItem::setPosition(const cnoid::Isometry3& T)
 {
-    position_ = T;
+    resolvePendingLoad();
+    setPositionMembers(T);
+    updateFlagPosition();
+    notifyUpdate();
+}
+
+void BodyPositionItem::setPosition(const cnoid::Vector3& translation, const cnoid::Quaternion& rotation)
+{
+    resolvePendingLoad();
+    translation_ = translation;
+    rotation_ = rotation.normalized();
     updateFlagPosition();
     notifyUpdate();
 }
 
+cnoid::Isometry3 BodyPositionItem::position() const
+{
+    resolvePendingLoad();
+    Isometry3 T;
+    T.linear() = rotation_.toRotationMatrix();
+    T.translation() = translation_;
+    return T;
+}
+
+void BodyPositionItem::setPositionMembers(const cnoid::Isometry3& T)
+{
+    translation_ = T.translation();
+    rotation_ = Quaternion(T.linear());
+    rotation_.normalize();
+}
+
 void BodyPositionItem::onTreePathChanged()
 {
+    // The tree order of the registry is restored when it is enumerated next time
+    if(registryLink.isLinked){
+        isRegistryOrderDirty = true;
+    }
+
     auto newBodyItem = findOwnerItem<BodyItem>();
     if(newBodyItem && newBodyItem != bodyItem){
         bodyItem = newBodyItem;
@@ -59,8 +182,10 @@ void BodyPositionItem::onTreePathChanged()
 
 void BodyPositionItem::storeBodyPosition()
 {
+    BodyPositionTrace::Span span("BodyPositionItem::storeBodyPosition");
     if(bodyItem){
-        position_ = bodyItem->body()->rootLink()->position();
+        resolvePendingLoad();
+        setPositionMembers(bodyItem->body()->rootLink()->position());
         updateFlagPosition();
         mvout()
             << format("The current position of {0} has been stored to {1}.",
@@ -71,9 +196,14 @@ void BodyPositionItem::storeBodyPosition()
 
 void BodyPositionItem::restoreBodyPosition()
 {
+    BodyPositionTrace::Span span("BodyPositionItem::restoreBodyPosition");
     if(bodyItem){
-        bodyItem->body()->rootLink()->position() = position_;
-        bodyItem->notifyKinematicStateChange(true);
+        resolvePendingLoad();
+        bodyItem->body()->rootLink()->position() = position();
+        {
+            BodyPositionTrace::Span span("BodyItem::notifyKinematicStateChange");
+            bodyItem->notifyKinematicStateChange(true);
+        }
         mvout()
             << format("The position of {0} has been restored from {1}.",
                       bodyItem->name(), name())
@@ -83,6 +213,7 @@ void BodyPositionItem::restoreBodyPosition()
 
 SgNode* BodyPositionItem::getScene()
 {
+    resolvePendingLoad();
     if(!flag){
         createFlag();
     }
@@ -91,95 +222,109 @@ SgNode* BodyPositionItem::getScene()
 
 void BodyPositionItem::createFlag()
 {
+    BodyPositionTrace::Span span("BodyPositionItem::createFlag");
     if(!flag){
         flag = new SgPosTransform;
-        flagMaterial = new SgMaterial;
         updateFlagPosition();
-        updateFlagMaterial();
     } else {
         flag->clearChildren();
     }
+    isFlagPreviewActive_ = false;
+
+    // The pole is scaled and the top parts are moved while the flag height is previewed
+    flagPoleScale = new SgScaleTransform;
+    flag->addChild(flagPoleScale);
+    flagTop = new SgPosTransform;
+    flag->addChild(flagTop);
+
+    auto& shapes = flagShapes();
     
-    MeshGenerator meshGenerator;
-    
-    auto pole = new SgShape;
-    pole->setMesh(meshGenerator.generateCylinder(0.01, flagHeight_));
-    pole->getOrCreateMaterial()->setDiffuseColor(Vector3f(0.7f, 0.7f, 0.7f));
+    auto poleHeight = new SgScaleTransform;
+    poleHeight->setScale(Vector3(1.0, flagHeight_, 1.0));
+    poleHeight->addChild(shapes.pole);
     auto polePos = new SgPosTransform;
     polePos->setRotation(AngleAxis(radian(90.0), Vector3::UnitX()));
     polePos->setTranslation(Vector3(0.0, 0.0, flagHeight_ / 2.0));
-    polePos->addChild(pole);
-    flag->addChild(polePos);
+    polePos->addChild(poleHeight);
+    flagPoleScale->addChild(polePos);
     
-    auto ornament = new SgShape;
-    ornament->setMesh(meshGenerator.generateSphere(0.02));
-    ornament->getOrCreateMaterial()->setDiffuseColor(Vector3f(1.0f, 1.0f, 0.0f));
     auto ornamentPos = new SgPosTransform;
     ornamentPos->setTranslation(Vector3(0.0, 0.0, flagHeight_ + 0.01));
-    ornamentPos->addChild(ornament);
-    flag->addChild(ornamentPos);
+    ornamentPos->addChild(shapes.ornament);
+    flagTop->addChild(ornamentPos);
     
-    auto banner = new SgShape;
-    banner->setMesh(meshGenerator.generateBox(Vector3(0.002, 0.3, 0.2)));
-    banner->setMaterial(flagMaterial);
     auto bannerPos = new SgPosTransform;
     bannerPos->setTranslation(Vector3(0.0, 0.16, flagHeight_ - 0.1));
-    bannerPos->addChild(banner);
-    flag->addChild(bannerPos);
+    bannerPos->addChild(shapes.banners[flagColor_]);
+    flagTop->addChild(bannerPos);
 }
 
-void BodyPositionItem::updateFlagPosition()
+void BodyPositionItem::previewFlagHeight(double height)
+{
+    if(flag && height > 0.0){
+        flagPoleScale->setScale(Vector3(1.0, 1.0, height / flagHeight_));
+        flagTop->setTranslation(Vector3(0.0, 0.0, height - flagHeight_));
+        flagPoleScale->notifyUpdate();
+        flagTop->notifyUpdate();
+        isFlagPreviewActive_ = true;
+    }
+}
+
+void BodyPositionItem::previewFlagOrientation(double yaw)
 {
     if(flag){
-        auto p = position_.translation();
-        flag->setTranslation(Vector3(p.x(), p.y(), 0.0));
-        auto rpy = rpyFromRot(position_.linear());
-        flag->setRotation(AngleAxis(rpy.z(), Vector3::UnitZ()));
+        flag->setRotation(AngleAxis(yaw, Vector3::UnitZ()));
         flag->notifyUpdate();
+        isFlagPreviewActive_ = true;
     }
 }
 
-void BodyPositionItem::updateFlagMaterial()
+void BodyPositionItem::cancelFlagPreview()
 {
-    if(flagMaterial){
-        switch(flagColorSelection.which()){
-        case Red:
-            flagMaterial->setDiffuseColor(Vector3f(1.0f, 0.0f, 0.0f));
-            break;
-        case Green:
-            flagMaterial->setDiffuseColor(Vector3f(0.0f, 1.0f, 0.0f));
-            break;
-        case Blue:
-            flagMaterial->setDiffuseColor(Vector3f(0.0f, 0.0f, 1.0f));
-            break;
-        default:
-            break;
-        }
-        flagMaterial->notifyUpdate();
+    if(isFlagPreviewActive_){
+        flagPoleScale->setScale(Vector3::Ones());
+        flagTop->setTranslation(Vector3::Zero());
+        flagPoleScale->notifyUpdate();
+        flagTop->notifyUpdate();
+        updateFlagPosition();
+        isFlagPreviewActive_ = false;
+    }
+}
+
+void BodyPositionItem::updateFlagPosition()
+{
+    if(flag){
+        flag->setTranslation(Vector3(translation_.x(), translation_.y(), 0.0));
+        auto rpy = rpyFromRot(rotation_.toRotationMatrix());
+        flag->setRotation(AngleAxis(rpy.z(), Vector3::UnitZ()));
+        flag->notifyUpdate();
     }
-}        
+}
 
 void BodyPositionItem::doPutProperties(cnoid::PutPropertyFunction& putProperty)
 {
-    auto p = position_.translation();
+    resolvePendingLoad();
+    auto& p = translation_;
     putProperty("Translation", format("{0:.3g} {1:.3g} {2:.3g}", p.x(), p.y(), p.z()),
                 [this](const string& text){
                     Vector3 p;
                     if(toVector3(text, p)){
-                        position_.translation() = p;
-                        setPosition(position_);
+                        auto T = position();
+                        T.translation() = p;
+                        setPosition(T);
                         return true;
                     }
                     return false;
                 });
 
-    auto r = degree(rpyFromRot(position_.linear()));
+    auto r = degree(rpyFromRot(rotation_.toRotationMatrix()));
     putProperty("Rotation", format("{0:.0f} {1:.0f} {2:.0f}", r.x(), r.y(), r.z()),
                 [this](const string& text){
                     Vector3 rpy;
                     if(toVector3(text, rpy)){
-                        position_.linear() = rotFromRpy(radian(rpy));
-                        setPosition(position_);
+                        auto T = position();
+                        T.linear() = rotFromRpy(radian(rpy));
+                        setPosition(T);
                         return true;
                     }
                     return false;
@@ -188,6 +333,11 @@ void BodyPositionItem::doPutProperties(cnoid::PutPropertyFunction& putProperty)
     putProperty.min(0.1)("Flag height", flagHeight_,
                 [this](double height){ return setFlagHeight(height); });
 
+    Selection flagColorSelection(NumFlagColors);
+    for(int i=0; i < NumFlagColors; ++i){
+        flagColorSelection.setSymbol(i, flagColorSymbol(i));
+    }
+    flagColorSelection.select(flagColor_);
     putProperty("Flag color", flagColorSelection,
                 [this](int which){ return setFlagColor(which); });
 }
@@ -197,6 +347,7 @@ bool BodyPositionItem::setFlagHeight(double height)
     if(height <= 0.0){
         return false;
     }
+    resolvePendingLoad();
     flagHeight_ = height;
     if(flag){
         createFlag();
@@ -208,10 +359,15 @@ bool BodyPositionItem::setFlagHeight(double height)
 
 bool BodyPositionItem::setFlagColor(int colorId)
 {
-    if(!flagColorSelection.select(colorId)){
+    if(colorId < 0 || colorId >= NumFlagColors){
         return false;
     }
-    updateFlagMaterial();
+    resolvePendingLoad();
+    flagColor_ = colorId;
+    if(flag){
+        createFlag();
+        flag->notifyUpdate();
+    }
     notifyUpdate();
     return true;
 }
@@ -220,12 +376,19 @@ void BodyPositionItem::notifyUpdate()
 {
     Item::notifyUpdate();
     suggestFileUpdate();
+    BodyPositionFileSaver::instance()->requestSave(this);
 }
 
 bool BodyPositionItem::store(cnoid::Archive& archive)
 {
     bool stored = false;
-    if(overwrite()){
+    auto saver = BodyPositionFileSaver::instance();
+    if(saver->isEnabled() && !isConsistentWithFile() &&
+       !filePath().empty() && fileFormat() == "BODY-POSITION"){
+        // The file is saved without blocking the GUI
+        saver->requestSaveNow(this);
+        stored = archive.writeFileInformation(this);
+    } else if(overwrite()){
          stored = archive.writeFileInformation(this);
     }
     return stored;
@@ -233,40 +396,116 @@ bool BodyPositionItem::store(cnoid::Archive& archive)
 
 bool BodyPositionItem::restore(const cnoid::Archive& archive)
 {
+    if(isLazyLoadingEnabled_){
+        string filename = archive.readItemFilePath();
+        string formatId;
+        if(!filename.empty() && archive.read("format", formatId) && formatId == "BODY-POSITION"){
+            if(!stdx::filesystem::exists(filename)){
+                mvout() << format("\"{0}\" does not exist.", filename) << endl;
+                return false;
+            }
+            // Only the file information is recorded here. See loadPendingFile.
+            MappingPtr options;
+            auto orgOptions = archive.findMapping("options");
+            if(orgOptions->isValid()){
+                options = orgOptions->cloneMapping();
+            }
+            updateFileInformation(filename, formatId, options);
+            isLoadPending_ = true;
+            return true;
+        }
+    }
     return archive.loadFileTo(this);
 }
 
+void BodyPositionItem::loadPendingFile() const
+{
+    BodyPositionTrace::Span span("BodyPositionItem::loadPendingFile");
+    auto self = const_cast<BodyPositionItem*>(this);
+    self->isLoadPending_ = false;
+    LengthUnit lengthUnit;
+    AngleUnit angleUnit;
+    readUnitOptions(fileOptions(), lengthUnit, angleUnit);
+    ostringstream os;
+    self->loadBodyPosition(filePath(), lengthUnit, angleUnit, os);
+
+    pendingLoadMessages += os.str();
+    loadedPendingItems.push_back(self);
+    if(!isPendingLoadNotificationRequested){
+        isPendingLoadNotificationRequested = true;
+        callLater([](){ notifyPendingFileLoads(); });
+    }
+}
+
+void BodyPositionItem::readUnitOptions
+(const cnoid::Mapping* options, LengthUnit& out_lengthUnit, AngleUnit& out_angleUnit)
+{
+    out_lengthUnit = Meter;
+    out_angleUnit = Degree;
+    if(options){
+        string unit;
+        if(options->read("length_unit", unit)){
+            readLengthUnit(unit, out_lengthUnit);
+        }
+        if(options->read("angle_unit", unit)){
+            readAngleUnit(unit, out_angleUnit);
+        }
+    }
+}
+
 bool BodyPositionItem::loadBodyPosition
 (const std::string& filename, LengthUnit lengthUnit, AngleUnit angleUnit, std::ostream& os)
 {
-    YAMLReader reader;
-    MappingPtr archive;
-    try {
-        archive = reader.loadDocument(filename)->toMapping();
+    BodyPositionTrace::Span span("BodyPositionItem::loadBodyPosition");
+    BodyPositionParser parser;
+    if(!parser.load(filename)){
+        os << parser.errorMessage() << endl;
+        return false;
     }
-    catch(const ValueNode::Exception& ex){
-        os << ex.message() << endl;
+    double lengthRatio = BodyPositionFormat::lengthRatio(lengthUnit, Meter);
+    if(parser.hasTranslation){
+        translation_ = lengthRatio * parser.translation;
     }
-    double lengthRatio = 1.0;
-    if(lengthUnit == Millimeter){
-        lengthRatio /= 1000.0;
+    if(parser.hasRotation){
+        Vector3 v = angleRatio(angleUnit, Radian) * parser.rotation;
+        rotation_ = Quaternion(rotFromRpy(v));
     }
-    Vector3 v;
-    if(read(archive, "translation", v)){
-        position_.translation() = lengthRatio * v;
+    if(parser.hasFlagHeight){
+        flagHeight_ = lengthRatio * parser.flagHeight;
     }
-    if(read(archive, "rotation", v)){
-        if(angleUnit == Degree){
-            v = radian(v);
+    if(parser.hasFlagColor){
+        int colorId = findFlagColor(parser.flagColor);
+        if(colorId >= 0){
+            flagColor_ = colorId;
         }
-        position_.linear() = rotFromRpy(v);
     }
-    if(archive->read("flag_height", flagHeight_)){
-        flagHeight_ *= lengthRatio;
+    return true;
+}
+
+bool BodyPositionItem::reloadBodyPositionFile(std::ostream& os)
+{
+    BodyPositionTrace::Span span("BodyPositionItem::reloadBodyPositionFile");
+    MappingPtr options;
+    if(auto orgOptions = fileOptions()){
+        options = orgOptions->cloneMapping();
+    }
+    if(!isLoadPending_){
+        LengthUnit lengthUnit;
+        AngleUnit angleUnit;
+        readUnitOptions(options, lengthUnit, angleUnit);
+        if(!loadBodyPosition(filePath(), lengthUnit, angleUnit, os)){
+            return false;
+        }
+        if(flag){
+            createFlag();
+            updateFlagPosition();
+            flag->notifyUpdate();
+        }
     }
-    string color;
-    if(archive->read("flag_color", color)){
-        flagColorSelection.select(color);
+    updateFileInformation(filePath(), fileFormat(), options);
+    if(!isLoadPending_){
+        // The file does not have to be updated, so Item::notifyUpdate is called directly
+        Item::notifyUpdate();
     }
     return true;
 }
@@ -274,47 +513,328 @@ bool BodyPositionItem::loadBodyPosition
 bool BodyPositionItem::saveBodyPosition
 (const std::string& filename, LengthUnit lengthUnit, AngleUnit angleUnit, std::ostream& os)
 {
-    YAMLWriter writer;
+    BodyPositionTrace::Span span("BodyPositionItem::saveBodyPosition");
+    BodyPositionWriter writer;
     if(!writer.openFile(filename)){
         os << format("Failed to open \"{0}\".", filename) << endl;
         return false;
     }
-    
-    MappingPtr archive = new Mapping;
-    double lengthRatio = 1.0;
-    if(lengthUnit == Millimeter){
-        lengthRatio = 1000.0;
-    }
-    write(archive, "translation", Vector3(lengthRatio * position_.translation()));
-    Vector3 rpy = rpyFromRot(position_.linear());
-    if(angleUnit == Degree){
-        rpy = degree(rpy);
+    putBodyPosition(writer, lengthUnit, angleUnit);
+    if(!writer.closeFile()){
+        os << format("Failed to write \"{0}\".", filename) << endl;
+        return false;
     }
-    write(archive, "rotation", rpy);
-    archive->write("flag_height", lengthRatio * flagHeight_);
-    archive->write("flag_color", flagColorSelection.selectedSymbol());
-    writer.putNode(archive);
-
     return true;
 }
 
+void BodyPositionItem::putBodyPosition
+(BodyPositionWriter& writer, LengthUnit lengthUnit, AngleUnit angleUnit) const
+{
+    resolvePendingLoad();
+    double lengthRatio = BodyPositionFormat::lengthRatio(Meter, lengthUnit);
+    Vector3 rpy = angleRatio(Radian, angleUnit) * rpyFromRot(rotation_.toRotationMatrix());
+    writer.putBodyPosition(
+        lengthRatio * translation_, rpy,
+        lengthRatio * flagHeight_, flagColorSymbol(flagColor_));
+}
+
 namespace {
 
-Signal<void()> sigItemsInProjectChanged_;
+Signal<void(const ItemList<BodyPositionItem>& addedItems, const ItemList<BodyPositionItem>& removedItems)>
+sigItemsInProjectChanged_;
+
+int itemsInProjectChangeBatchCounter = 0;
+bool isItemsInProjectChangeNotificationScheduled = false;
+
+// The net changes are counted so that an item removed and added again in a cycle is not reported
+vector<BodyPositionItemPtr> changedItems;
+unordered_map<BodyPositionItem*, int> itemConnectionChanges;
+
+void flushItemsInProjectChange()
+{
+    isItemsInProjectChangeNotificationScheduled = false;
+    if(itemsInProjectChangeBatchCounter > 0 || changedItems.empty()){
+        return;
+    }
+    ItemList<BodyPositionItem> addedItems;
+    ItemList<BodyPositionItem> removedItems;
+    for(auto& item : changedItems){
+        auto p = itemConnectionChanges.find(item);
+        if(p != itemConnectionChanges.end()){
+            if(p->second > 0){
+                addedItems.push_back(item);
+            } else if(p->second < 0){
+                removedItems.push_back(item);
+            }
+            itemConnectionChanges.erase(p);
+        }
+    }
+    changedItems.clear();
+    if(!addedItems.empty() || !removedItems.empty()){
+        sigItemsInProjectChanged_(addedItems, removedItems);
+    }
+}
+
+void notifyItemsInProjectChange(BodyPositionItem* item, int change)
+{
+    auto& netChange = itemConnectionChanges[item];
+    if(netChange == 0){
+        changedItems.push_back(item);
+    }
+    netChange += change;
+    if(!isItemsInProjectChangeNotificationScheduled && itemsInProjectChangeBatchCounter == 0){
+        isItemsInProjectChangeNotificationScheduled = true;
+        callLater(flushItemsInProjectChange);
+    }
+}
 
 }
 
-SignalProxy<void()> BodyPositionItem::sigItemsInProjectChanged()
+SignalProxy<void(const ItemList<BodyPositionItem>& addedItems, const ItemList<BodyPositionItem>& removedItems)>
+BodyPositionItem::sigItemsInProjectChanged()
 {
     return sigItemsInProjectChanged_;
 }
 
+void BodyPositionItem::beginItemsInProjectChangeBatch()
+{
+    ++itemsInProjectChangeBatchCounter;
+}
+
+void BodyPositionItem::endItemsInProjectChangeBatch()
+{
+    if(--itemsInProjectChangeBatchCounter == 0){
+        flushItemsInProjectChange();
+    }
+}
+
+struct BodyPositionItem::Registry
+{
+    BodyPositionItem* head;
+    BodyPositionItem* tail;
+    int size;
+    RegistryLink BodyPositionItem::* link;
+};
+
+BodyPositionItem::Registry BodyPositionItem::registry =
+    { nullptr, nullptr, 0, &BodyPositionItem::registryLink };
+BodyPositionItem::Registry BodyPositionItem::selectedRegistry =
+    { nullptr, nullptr, 0, &BodyPositionItem::selectedRegistryLink };
+bool BodyPositionItem::isRegistryOrderDirty = false;
+bool BodyPositionItem::isSelectedRegistryOrderDirty = false;
+
+void BodyPositionItem::appendToRegistry(Registry& registry, BodyPositionItem* item)
+{
+    auto& link = item->*registry.link;
+    link.prev = registry.tail;
+    link.next = nullptr;
+    if(registry.tail){
+        (registry.tail->*registry.link).next = item;
+    } else {
+        registry.head = item;
+    }
+    registry.tail = item;
+    link.isLinked = true;
+    ++registry.size;
+}
+
+void BodyPositionItem::relinkRegistry(Registry& registry, const vector<BodyPositionItem*>& items)
+{
+    BodyPositionItem* prevItem = nullptr;
+    for(auto& item : items){
+        auto& link = item->*registry.link;
+        link.prev = prevItem;
+        link.next = nullptr;
+        if(prevItem){
+            (prevItem->*registry.link).next = item;
+        }
+        prevItem = item;
+    }
+    registry.head = items.empty() ? nullptr : items.front();
+    registry.tail = prevItem;
+}
+
+/**
+   The items are appended to the registry when they are connected to the root item, and the
+   tree order is restored by a traversal of the item tree when the registry is enumerated.
+   The order keys are renumbered by the traversal.
+*/
+void BodyPositionItem::updateRegistryOrder()
+{
+    BodyPositionTrace::Span span("BodyPositionItem::updateRegistryOrder");
+
+    isRegistryOrderDirty = false;
+
+    for(auto item = registry.head; item; item = item->registryLink.next){
+        item->registryLink.orderKey = -1;
+    }
+    vector<BodyPositionItem*> items;
+    items.reserve(registry.size);
+    int64_t key = 0;
+    Item* root = RootItem::instance();
+    Item* item = root->childItem();
+    while(item){
+        auto positionItem = dynamic_cast<BodyPositionItem*>(item);
+        if(positionItem && positionItem->registryLink.isLinked){
+            positionItem->registryLink.orderKey = key++;
+            items.push_back(positionItem);
+        }
+        if(auto child = item->childItem()){
+            item = child;
+        } else {
+            while(item != root && !item->nextItem()){
+                item = item->parentItem();
+            }
+            item = (item != root) ? item->nextItem() : nullptr;
+        }
+    }
+    // The items being detached from the tree are kept at the end until they are unregistered
+    if(static_cast<int>(items.size()) < registry.size){
+        for(auto item = registry.head; item; item = item->registryLink.next){
+            if(item->registryLink.orderKey < 0){
+                item->registryLink.orderKey = key++;
+                items.push_back(item);
+            }
+        }
+    }
+    relinkRegistry(registry, items);
+
+    isSelectedRegistryOrderDirty = true;
+}
+
+// The selected items are sorted by the order keys
+void BodyPositionItem::updateSelectedRegistryOrder()
+{
+    if(isRegistryOrderDirty){
+        updateRegistryOrder();
+    }
+    isSelectedRegistryOrderDirty = false;
+
+    vector<BodyPositionItem*> items;
+    items.reserve(selectedRegistry.size);
+    for(auto item = selectedRegistry.head; item; item = item->selectedRegistryLink.next){
+        items.push_back(item);
+    }
+    std::sort(items.begin(), items.end(),
+              [](BodyPositionItem* item1, BodyPositionItem* item2){
+                  return item1->registryLink.orderKey < item2->registryLink.orderKey; });
+    relinkRegistry(selectedRegistry, items);
+}
+
+void BodyPositionItem::addToSelectedRegistry(BodyPositionItem* item)
+{
+    if(!item->selectedRegistryLink.isLinked){
+        appendToRegistry(selectedRegistry, item);
+        isSelectedRegistryOrderDirty = true;
+    }
+}
+
+void BodyPositionItem::removeFromRegistry(Registry& registry, BodyPositionItem* item)
+{
+    auto& link = item->*registry.link;
+    if(link.isLinked){
+        if(link.prev){
+            (link.prev->*registry.link).next = link.next;
+        } else {
+            registry.head = link.next;
+        }
+        if(link.next){
+            (link.next->*registry.link).prev = link.prev;
+        } else {
+            registry.tail = link.prev;
+        }
+        link.prev = nullptr;
+        link.next = nullptr;
+        link.isLinked = false;
+        --registry.size;
+    }
+}
+
+ItemList<BodyPositionItem> BodyPositionItem::getRegistryItems(const Registry& registry)
+{
+    ItemList<BodyPositionItem> items;
+    items.reserve(registry.size);
+    for(auto item = registry.head; item; item = (item->*registry.link).next){
+        items.push_back(item);
+    }
+    return items;
+}
+
+int BodyPositionItem::numRegisteredItems()
+{
+    return registry.size;
+}
+
+ItemList<BodyPositionItem> BodyPositionItem::registeredItems()
+{
+    if(isRegistryOrderDirty){
+        updateRegistryOrder();
+    }
+    return getRegistryItems(registry);
+}
+
+BodyPositionItem* BodyPositionItem::firstRegisteredItem()
+{
+    if(isRegistryOrderDirty){
+        updateRegistryOrder();
+    }
+    return registry.head;
+}
+
+int BodyPositionItem::numSelectedRegisteredItems()
+{
+    return selectedRegistry.size;
+}
+
+ItemList<BodyPositionItem> BodyPositionItem::selectedRegisteredItems()
+{
+    if(isRegistryOrderDirty || isSelectedRegistryOrderDirty){
+        updateSelectedRegistryOrder();
+    }
+    return getRegistryItems(selectedRegistry);
+}
+
+BodyPositionItem* BodyPositionItem::firstSelectedRegisteredItem()
+{
+    if(isRegistryOrderDirty || isSelectedRegistryOrderDirty){
+        updateSelectedRegistryOrder();
+    }
+    return selectedRegistry.head;
+}
+
+void BodyPositionItem::onSelectionChanged(bool on)
+{
+    if(on){
+        addToSelectedRegistry(this);
+    } else {
+        removeFromRegistry(selectedRegistry, this);
+    }
+}
+
 void BodyPositionItem::onConnectedToRoot()
 {
-    sigItemsInProjectChanged_();
+    if(!registryLink.isLinked){
+        appendToRegistry(registry, this);
+        isRegistryOrderDirty = true;
+    }
+    if(isSelected()){
+        addToSelectedRegistry(this);
+    }
+    selectionConnection =
+        sigSelectionChanged().connect(
+            [this](bool on){ onSelectionChanged(on); });
+
+    BodyPositionFileWatcher::instance()->addItem(this);
+    notifyItemsInProjectChange(this, 1);
 }
 
 void BodyPositionItem::onDisconnectedFromRoot()
 {
-    sigItemsInProjectChanged_();
+    selectionConnection.disconnect();
+    removeFromRegistry(selectedRegistry, this);
+    removeFromRegistry(registry, this);
+
+    BodyPositionFileWatcher::instance()->removeItem(this);
+    BodyPositionFileSaver::instance()->cancelSave(this);
+    notifyItemsInProjectChange(this, -1);
 }
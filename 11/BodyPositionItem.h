@@ -1,14 +1,20 @@
 #ifndef DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_H
 #define DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_H
 
+#include "BodyPositionFormat.h"
 #include <cnoid/Item>
 #include <cnoid/RenderableItem>
 #include <cnoid/BodyItem>
 #include <cnoid/SceneGraph>
 #include <cnoid/SceneDrawables>
-#include <cnoid/Selection>
+#include <cnoid/ItemList>
+#include <cstdint>
+#include "exportdecl.h"
 
-class BodyPositionItem : public cnoid::Item, public cnoid::RenderableItem
+class BodyPositionWriter;
+
+// The units and the flag colors are defined in BodyPositionFormat
+class CNOID_EXPORT BodyPositionItem : public cnoid::Item, public cnoid::RenderableItem, public BodyPositionFormat
 {
 public:
     static void initializeClass(cnoid::ExtensionManager* ext);
@@ -16,24 +22,87 @@ public:
     BodyPositionItem();
     BodyPositionItem(const BodyPositionItem& org);
     void setPosition(const cnoid::Isometry3& T);
-    const cnoid::Isometry3& position() const { return position_; }
+    // The rotation is normalized
+    void setPosition(const cnoid::Vector3& translation, const cnoid::Quaternion& rotation);
+    /**
+       The position is returned by value because it is composed from the stored translation and
+       quaternion. Bind the result to a local variable instead of keeping a reference to it.
+    */
+    cnoid::Isometry3 position() const;
+    const cnoid::Vector3& translation() const { resolvePendingLoad(); return translation_; }
+    const cnoid::Quaternion& rotation() const { resolvePendingLoad(); return rotation_; }
     void storeBodyPosition();
     void restoreBodyPosition();
+    cnoid::BodyItem* ownerBodyItem() const { return bodyItem; }
     virtual cnoid::SgNode* getScene() override;
     bool setFlagHeight(double height);
-    double flagHeight() const { return flagHeight_; }
-    enum ColorId { Red, Green, Blue };
+    double flagHeight() const { resolvePendingLoad(); return flagHeight_; }
     bool setFlagColor(int colorId);
-    double flagColor() const { return flagColorSelection.which(); }
+    double flagColor() const { resolvePendingLoad(); return flagColor_; }
+
+    /**
+       The preview functions only move the flag in the scene. The item itself is not updated
+       and no signal is emitted until the value is set by the corresponding set function.
+    */
+    void previewFlagHeight(double height);
+    void previewFlagOrientation(double yaw);
+    void cancelFlagPreview();
+    bool isFlagPreviewActive() const { return isFlagPreviewActive_; }
 
-    enum LengthUnit { Meter, Millimeter };
-    enum AngleUnit { Degree, Radian };
     bool loadBodyPosition(
         const std::string& filename, LengthUnit lengthUnit, AngleUnit anguleUnit, std::ostream& os);
     bool saveBodyPosition(
         const std::string& filename, LengthUnit lengthUnit, AngleUnit anguleUnit, std::ostream& os);
+    bool reloadBodyPositionFile(std::ostream& os);
+    void putBodyPosition(BodyPositionWriter& writer, LengthUnit lengthUnit, AngleUnit angleUnit) const;
+    static void readUnitOptions(
+        const cnoid::Mapping* options, LengthUnit& out_lengthUnit, AngleUnit& out_angleUnit);
+
+    // The file of an item restored from a project is loaded when its contents are first needed
+    static void setLazyLoadingEnabled(bool on);
+    static bool isLazyLoadingEnabled();
+    bool isLoadPending() const { return isLoadPending_; }
+    /**
+       The pending file is loaded by this function before the contents are read. The getters also
+       load the file if it is pending, but the messages and the signal of a load are deferred to
+       the event loop in both cases so that the callers of the getters are not reentered.
+    */
+    void ensureLoaded() { resolvePendingLoad(); }
+    // This signal is emitted in the event loop after the pending file of an item has been loaded
+    static cnoid::SignalProxy<void(BodyPositionItem* item)> sigPendingFileLoaded();
+
+    /**
+       The changes of the items in the project are notified at most once in an event loop cycle.
+       The notification is deferred until the end of the batch if a batch is in progress.
+    */
+    static cnoid::SignalProxy<
+        void(const cnoid::ItemList<BodyPositionItem>& addedItems,
+             const cnoid::ItemList<BodyPositionItem>& removedItems)> sigItemsInProjectChanged();
 
-    static cnoid::SignalProxy<void()> sigItemsInProjectChanged();
+    static void beginItemsInProjectChangeBatch();
+    static void endItemsInProjectChangeBatch();
+
+    /**
+       The items connected to the root item are registered in the tree order. The tree order key
+       of an item is larger than the keys of the items preceding it in the tree. The order is
+       restored when the registry is enumerated from the first item after the tree is changed.
+    */
+    static int numRegisteredItems();
+    static cnoid::ItemList<BodyPositionItem> registeredItems();
+    static BodyPositionItem* firstRegisteredItem();
+    BodyPositionItem* nextRegisteredItem() const { return registryLink.next; }
+    BodyPositionItem* prevRegisteredItem() const {
+        if(isRegistryOrderDirty) updateRegistryOrder();
+        return registryLink.prev;
+    }
+    int64_t treeOrderKey() const {
+        if(isRegistryOrderDirty) updateRegistryOrder();
+        return registryLink.orderKey;
+    }
+    static int numSelectedRegisteredItems();
+    static cnoid::ItemList<BodyPositionItem> selectedRegisteredItems();
+    static BodyPositionItem* firstSelectedRegisteredItem();
+    BodyPositionItem* nextSelectedRegisteredItem() const { return selectedRegistryLink.next; }
 
 protected:
     virtual Item* doDuplicate() const override;
@@ -48,14 +117,50 @@ protected:
 private:
     void createFlag();
     void updateFlagPosition();
-    void updateFlagMaterial();
+    void setPositionMembers(const cnoid::Isometry3& T);
+    void resolvePendingLoad() const { if(isLoadPending_) loadPendingFile(); }
+    void loadPendingFile() const;
+
+    struct RegistryLink
+    {
+        BodyPositionItem* prev;
+        BodyPositionItem* next;
+        int64_t orderKey;
+        bool isLinked;
+        RegistryLink() : prev(nullptr), next(nullptr), orderKey(0), isLinked(false) { }
+    };
+    struct Registry;
+    static Registry registry;
+    static Registry selectedRegistry;
+    static bool isRegistryOrderDirty;
+    static bool isSelectedRegistryOrderDirty;
+    static void appendToRegistry(Registry& registry, BodyPositionItem* item);
+    static void relinkRegistry(Registry& registry, const std::vector<BodyPositionItem*>& items);
+    static void updateRegistryOrder();
+    static void updateSelectedRegistryOrder();
+    static void addToSelectedRegistry(BodyPositionItem* item);
+    static void removeFromRegistry(Registry& registry, BodyPositionItem* item);
+    static cnoid::ItemList<BodyPositionItem> getRegistryItems(const Registry& registry);
+    void onSelectionChanged(bool on);
 
+    /**
+       The position is stored as the translation and the unit quaternion, and the flag color is
+       stored as its id. The symbols of the colors and the shapes of the flag are shared by all
+       the items.
+    */
     cnoid::BodyItem* bodyItem;
-    cnoid::Isometry3 position_;
-    cnoid::SgPosTransformPtr flag;
+    cnoid::Vector3 translation_;
+    cnoid::Quaternion rotation_;
     double flagHeight_;
-    cnoid::Selection flagColorSelection;
-    cnoid::SgMaterialPtr flagMaterial;
+    unsigned char flagColor_;
+    bool isFlagPreviewActive_;
+    bool isLoadPending_;
+    cnoid::SgPosTransformPtr flag;
+    cnoid::SgScaleTransformPtr flagPoleScale;
+    cnoid::SgPosTransformPtr flagTop;
+    RegistryLink registryLink;
+    RegistryLink selectedRegistryLink;
+    cnoid::ScopedConnection selectionConnection;
 };
 
 typedef cnoid::ref_ptr<BodyPositionItem> BodyPositionItemPtr;
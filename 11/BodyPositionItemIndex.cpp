@@ -0,0 +1,493 @@
+#include "BodyPositionItemIndex.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/LazyCaller>
+#include <cnoid/ConnectionSet>
+#include <cnoid/EigenUtil>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+const int NumFlagColors = BodyPositionFormat::NumFlagColors;
+const int UnknownFlagColor = -1;
+
+string toLowerCase(const string& s)
+{
+    string lower(s);
+    for(auto& c : lower){
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+    return lower;
+}
+
+bool startsWith(const string& s, const string& prefix)
+{
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+template<class GetKey>
+void sortItemsByKey(ItemList<BodyPositionItem>& items, GetKey getKey, bool isDescending)
+{
+    typedef decltype(getKey(nullptr)) Key;
+    vector<pair<Key, BodyPositionItem*>> keys;
+    keys.reserve(items.size());
+    for(auto& item : items){
+        keys.emplace_back(getKey(item), item);
+    }
+    if(isDescending){
+        stable_sort(keys.begin(), keys.end(),
+                    [](const pair<Key, BodyPositionItem*>& a, const pair<Key, BodyPositionItem*>& b){
+                        return a.first > b.first; });
+    } else {
+        stable_sort(keys.begin(), keys.end(),
+                    [](const pair<Key, BodyPositionItem*>& a, const pair<Key, BodyPositionItem*>& b){
+                        return a.first < b.first; });
+    }
+    for(size_t i=0; i < keys.size(); ++i){
+        items[i] = keys[i].second;
+    }
+}
+
+}
+
+class BodyPositionItemIndex::Impl
+{
+public:
+    struct Entry
+    {
+        string nameKey;
+        BodyItem* owner;
+        // UnknownFlagColor until the pending file of the item is loaded
+        int flagColor;
+        int ownerIndex;
+        int colorIndex;
+        // The values used for sorting are compared to notify their changes
+        double flagHeight;
+        double yaw;
+        ScopedConnectionSet connections;
+    };
+    unordered_map<BodyPositionItem*, unique_ptr<Entry>> entries;
+
+    // Sorted by the lower case names
+    typedef pair<string, BodyPositionItem*> NameKey;
+    vector<NameKey> sortedNames;
+
+    // The owner items are held until their position items are removed from the index
+    struct OwnerBucket
+    {
+        BodyItemPtr owner;
+        vector<BodyPositionItem*> items;
+    };
+    unordered_map<BodyItem*, OwnerBucket> ownerBuckets;
+    vector<BodyPositionItem*> colorBuckets[NumFlagColors];
+    vector<BodyPositionItem*> unknownColorBucket;
+
+    Signal<void(const ItemList<BodyPositionItem>& addedItems,
+                const ItemList<BodyPositionItem>& removedItems)> sigItemsChanged;
+    Signal<void()> sigKeysChanged;
+    LazyCaller keysChangeNotifier;
+    ScopedConnection projectConnection;
+    ScopedConnection pendingFileLoadConnection;
+
+    Impl();
+    void addItems(const ItemList<BodyPositionItem>& items);
+    void removeItems(const ItemList<BodyPositionItem>& items);
+    void insertNames(vector<NameKey>& names);
+    void eraseNames(vector<NameKey>& names);
+    void insertKeys(BodyPositionItem* item, Entry* entry);
+    void eraseKeys(BodyPositionItem* item, Entry* entry);
+    vector<BodyPositionItem*>& colorBucket(int flagColor){
+        return flagColor == UnknownFlagColor ? unknownColorBucket : colorBuckets[flagColor];
+    }
+    void removeFromBucket(vector<BodyPositionItem*>& bucket, int index, int Entry::* indexMember);
+    bool updateSortValues(BodyPositionItem* item, Entry* entry);
+    void onItemKeysChanged(BodyPositionItem* item, bool isOrderChanged);
+    void onPendingFileLoaded(BodyPositionItem* item);
+    void onItemsInProjectChanged(
+        const ItemList<BodyPositionItem>& addedItems, const ItemList<BodyPositionItem>& removedItems);
+    bool matches(const Entry* entry, const Filter& filter, const string& lowerPrefix) const;
+    ItemList<BodyPositionItem> find(const Filter& filter);
+};
+
+BodyPositionItemIndex* BodyPositionItemIndex::instance()
+{
+    static BodyPositionItemIndex index;
+    return &index;
+}
+
+BodyPositionItemIndex::BodyPositionItemIndex()
+{
+    impl = new Impl;
+}
+
+BodyPositionItemIndex::Impl::Impl()
+{
+    keysChangeNotifier.setFunction([this](){ sigKeysChanged(); });
+
+    addItems(BodyPositionItem::registeredItems());
+    projectConnection =
+        BodyPositionItem::sigItemsInProjectChanged().connect(
+            [this](const ItemList<BodyPositionItem>& addedItems,
+                   const ItemList<BodyPositionItem>& removedItems){
+                onItemsInProjectChanged(addedItems, removedItems); });
+    pendingFileLoadConnection =
+        BodyPositionItem::sigPendingFileLoaded().connect(
+            [this](BodyPositionItem* item){ onPendingFileLoaded(item); });
+}
+
+BodyPositionItemIndex::~BodyPositionItemIndex()
+{
+    delete impl;
+}
+
+SignalProxy<void(const ItemList<BodyPositionItem>& addedItems,
+                 const ItemList<BodyPositionItem>& removedItems)>
+BodyPositionItemIndex::sigItemsChanged()
+{
+    return impl->sigItemsChanged;
+}
+
+SignalProxy<void()> BodyPositionItemIndex::sigKeysChanged()
+{
+    return impl->sigKeysChanged;
+}
+
+/**
+   The names of the added items are sorted and merged into the sorted names at once so that
+   adding many items does not shift the sorted names for each item.
+*/
+void BodyPositionItemIndex::Impl::addItems(const ItemList<BodyPositionItem>& items)
+{
+    vector<NameKey> names;
+    names.reserve(items.size());
+
+    for(auto& item : items){
+        auto& entry = entries[item];
+        if(entry){
+            continue;
+        }
+        entry.reset(new Entry);
+        entry->flagHeight = 0.0;
+        entry->yaw = 0.0;
+        entry->nameKey = toLowerCase(item->name());
+        names.emplace_back(entry->nameKey, item);
+        insertKeys(item, entry.get());
+        updateSortValues(item, entry.get());
+
+        // The name and the tree position are used for the order of the items
+        entry->connections.add(
+            item->sigNameChanged().connect(
+                [this, item](const string&){ onItemKeysChanged(item, true); }));
+        entry->connections.add(
+            item->sigTreePathChanged().connect(
+                [this, item](){ onItemKeysChanged(item, true); }));
+        entry->connections.add(
+            item->sigUpdated().connect(
+                [this, item](){ onItemKeysChanged(item, false); }));
+    }
+
+    insertNames(names);
+}
+
+void BodyPositionItemIndex::Impl::removeItems(const ItemList<BodyPositionItem>& items)
+{
+    vector<NameKey> names;
+    names.reserve(items.size());
+
+    for(auto& item : items){
+        auto p = entries.find(item);
+        if(p != entries.end()){
+            auto entry = p->second.get();
+            names.emplace_back(std::move(entry->nameKey), item);
+            eraseKeys(item, entry);
+            entries.erase(p);
+        }
+    }
+
+    eraseNames(names);
+}
+
+void BodyPositionItemIndex::Impl::insertNames(vector<NameKey>& names)
+{
+    if(names.empty()){
+        return;
+    }
+    std::sort(names.begin(), names.end());
+    auto numOrgNames = sortedNames.size();
+    sortedNames.insert(sortedNames.end(), names.begin(), names.end());
+    std::inplace_merge(sortedNames.begin(), sortedNames.begin() + numOrgNames, sortedNames.end());
+}
+
+// The remaining names are moved forward in one pass
+void BodyPositionItemIndex::Impl::eraseNames(vector<NameKey>& names)
+{
+    if(names.empty()){
+        return;
+    }
+    std::sort(names.begin(), names.end());
+    auto p = names.begin();
+    auto q = lower_bound(sortedNames.begin(), sortedNames.end(), *p);
+    auto out = q;
+    for(; q != sortedNames.end(); ++q){
+        while(p != names.end() && *p < *q){
+            ++p;
+        }
+        if(p == names.end() || *q < *p){
+            if(out != q){
+                *out = std::move(*q);
+            }
+            ++out;
+        }
+    }
+    sortedNames.erase(out, sortedNames.end());
+}
+
+// The name of the item is not indexed by this function
+void BodyPositionItemIndex::Impl::insertKeys(BodyPositionItem* item, Entry* entry)
+{
+    entry->owner = item->ownerBodyItem();
+    entry->ownerIndex = -1;
+    if(entry->owner){
+        auto& bucket = ownerBuckets[entry->owner];
+        if(!bucket.owner){
+            bucket.owner = entry->owner;
+        }
+        entry->ownerIndex = bucket.items.size();
+        bucket.items.push_back(item);
+    }
+
+    // The color of a pending item is left unknown so that its file is not loaded
+    entry->flagColor = item->isLoadPending() ? UnknownFlagColor : static_cast<int>(item->flagColor());
+    auto& bucket = colorBucket(entry->flagColor);
+    entry->colorIndex = bucket.size();
+    bucket.push_back(item);
+}
+
+void BodyPositionItemIndex::Impl::eraseKeys(BodyPositionItem* item, Entry* entry)
+{
+    if(entry->ownerIndex >= 0){
+        auto q = ownerBuckets.find(entry->owner);
+        removeFromBucket(q->second.items, entry->ownerIndex, &Entry::ownerIndex);
+        if(q->second.items.empty()){
+            ownerBuckets.erase(q);
+        }
+    }
+    removeFromBucket(colorBucket(entry->flagColor), entry->colorIndex, &Entry::colorIndex);
+}
+
+// The last element is moved to the position of the removed element
+void BodyPositionItemIndex::Impl::removeFromBucket
+(vector<BodyPositionItem*>& bucket, int index, int Entry::* indexMember)
+{
+    auto movedItem = bucket.back();
+    bucket[index] = movedItem;
+    entries[movedItem].get()->*indexMember = index;
+    bucket.pop_back();
+}
+
+// The values of a pending item are not read so that its file is not loaded
+bool BodyPositionItemIndex::Impl::updateSortValues(BodyPositionItem* item, Entry* entry)
+{
+    if(item->isLoadPending()){
+        return false;
+    }
+    double flagHeight = item->flagHeight();
+    double yaw = rpyFromRot(item->position().linear()).z();
+    if(flagHeight == entry->flagHeight && yaw == entry->yaw){
+        return false;
+    }
+    entry->flagHeight = flagHeight;
+    entry->yaw = yaw;
+    return true;
+}
+
+// The change is notified only when the keys or the values used for sorting have been changed
+void BodyPositionItemIndex::Impl::onItemKeysChanged(BodyPositionItem* item, bool isOrderChanged)
+{
+    auto p = entries.find(item);
+    if(p == entries.end()){
+        return;
+    }
+    auto entry = p->second.get();
+    int flagColor = item->isLoadPending() ? UnknownFlagColor : static_cast<int>(item->flagColor());
+    string nameKey = toLowerCase(item->name());
+    bool isNameChanged = entry->nameKey != nameKey;
+    bool isKeyChanged =
+        isNameChanged ||
+        entry->owner != item->ownerBodyItem() ||
+        entry->flagColor != flagColor;
+    if(isNameChanged){
+        auto p = lower_bound(sortedNames.begin(), sortedNames.end(), NameKey(entry->nameKey, item));
+        if(p != sortedNames.end() && p->second == item){
+            sortedNames.erase(p);
+        }
+        entry->nameKey = nameKey;
+        NameKey newKey(nameKey, item);
+        sortedNames.insert(lower_bound(sortedNames.begin(), sortedNames.end(), newKey), newKey);
+    }
+    if(isKeyChanged){
+        eraseKeys(item, entry);
+        insertKeys(item, entry);
+    }
+    bool isSortValueChanged = updateSortValues(item, entry);
+    if(isOrderChanged || isKeyChanged || isSortValueChanged){
+        keysChangeNotifier();
+    }
+}
+
+// The signal is emitted in the event loop, so the keys are updated directly
+void BodyPositionItemIndex::Impl::onPendingFileLoaded(BodyPositionItem* item)
+{
+    onItemKeysChanged(item, false);
+}
+
+void BodyPositionItemIndex::Impl::onItemsInProjectChanged
+(const ItemList<BodyPositionItem>& addedItems, const ItemList<BodyPositionItem>& removedItems)
+{
+    removeItems(removedItems);
+    addItems(addedItems);
+    sigItemsChanged(addedItems, removedItems);
+}
+
+bool BodyPositionItemIndex::matches(BodyPositionItem* item, const Filter& filter)
+{
+    if(!filter.namePrefix.empty() &&
+       !startsWith(toLowerCase(item->name()), toLowerCase(filter.namePrefix))){
+        return false;
+    }
+    if(filter.owner && item->ownerBodyItem() != filter.owner){
+        return false;
+    }
+    if(filter.flagColor >= 0){
+        item->ensureLoaded();
+        if(static_cast<int>(item->flagColor()) != filter.flagColor){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BodyPositionItemIndex::Impl::matches
+(const Entry* entry, const Filter& filter, const string& lowerPrefix) const
+{
+    return (lowerPrefix.empty() || startsWith(entry->nameKey, lowerPrefix)) &&
+        (!filter.owner || entry->owner == filter.owner) &&
+        (filter.flagColor < 0 || entry->flagColor == filter.flagColor);
+}
+
+ItemList<BodyPositionItem> BodyPositionItemIndex::find(const Filter& filter) const
+{
+    return impl->find(filter);
+}
+
+ItemList<BodyPositionItem> BodyPositionItemIndex::Impl::find(const Filter& filter)
+{
+    BodyPositionTrace::Span span("BodyPositionItemIndex::find");
+    if(filter.isEmpty()){
+        return BodyPositionItem::registeredItems();
+    }
+
+    // The pending files are loaded only when the items are filtered by the color
+    if(filter.flagColor >= 0 && filter.flagColor < NumFlagColors && !unknownColorBucket.empty()){
+        auto pendingItems = unknownColorBucket;
+        for(auto& item : pendingItems){
+            item->ensureLoaded();
+            onItemKeysChanged(item, false);
+        }
+    }
+
+    // The smallest candidate set is narrowed down by the other keys
+    BodyPositionItem* const* candidates = nullptr;
+    size_t numCandidates = entries.size();
+    vector<BodyPositionItem*> nameCandidates;
+
+    string lowerPrefix = toLowerCase(filter.namePrefix);
+    if(!lowerPrefix.empty()){
+        auto begin = lower_bound(
+            sortedNames.begin(), sortedNames.end(), NameKey(lowerPrefix, nullptr));
+        auto end = partition_point(
+            begin, sortedNames.end(),
+            [&](const NameKey& key){ return startsWith(key.first, lowerPrefix); });
+        nameCandidates.reserve(end - begin);
+        for(auto p = begin; p != end; ++p){
+            nameCandidates.push_back(p->second);
+        }
+        candidates = nameCandidates.data();
+        numCandidates = nameCandidates.size();
+    }
+    if(filter.owner){
+        auto p = ownerBuckets.find(filter.owner);
+        if(p == ownerBuckets.end()){
+            return ItemList<BodyPositionItem>();
+        }
+        if(p->second.items.size() <= numCandidates){
+            candidates = p->second.items.data();
+            numCandidates = p->second.items.size();
+        }
+    }
+    if(filter.flagColor >= 0){
+        if(filter.flagColor >= NumFlagColors){
+            return ItemList<BodyPositionItem>();
+        }
+        auto& bucket = colorBuckets[filter.flagColor];
+        if(bucket.size() <= numCandidates){
+            candidates = bucket.data();
+            numCandidates = bucket.size();
+        }
+    }
+
+    // The candidates are not checked when they are selected by the only key of the filter
+    int numKeys = (lowerPrefix.empty() ? 0 : 1) + (filter.owner ? 1 : 0) + (filter.flagColor >= 0 ? 1 : 0);
+    ItemList<BodyPositionItem> found;
+    found.reserve(numCandidates);
+    for(size_t i=0; i < numCandidates; ++i){
+        auto item = candidates[i];
+        if(numKeys == 1 || matches(entries.find(item)->second.get(), filter, lowerPrefix)){
+            found.push_back(item);
+        }
+    }
+    return found;
+}
+
+vector<BodyItem*> BodyPositionItemIndex::owners() const
+{
+    vector<BodyItem*> ownerItems;
+    ownerItems.reserve(impl->ownerBuckets.size());
+    for(auto& kv : impl->ownerBuckets){
+        ownerItems.push_back(kv.first);
+    }
+    std::sort(ownerItems.begin(), ownerItems.end(),
+              [](BodyItem* a, BodyItem* b){ return a->name() < b->name(); });
+    return ownerItems;
+}
+
+void BodyPositionItemIndex::sort(ItemList<BodyPositionItem>& items, SortKey key, bool isDescending)
+{
+    if(key == SortByFlagHeight || key == SortByYaw){
+        for(auto& item : items){
+            item->ensureLoaded();
+        }
+    }
+    switch(key){
+    case SortByName:
+        sortItemsByKey(items, [](BodyPositionItem* item){ return item->name(); }, isDescending);
+        break;
+    case SortByFlagHeight:
+        sortItemsByKey(items, [](BodyPositionItem* item){ return item->flagHeight(); }, isDescending);
+        break;
+    case SortByYaw:
+        sortItemsByKey(
+            items,
+            [](BodyPositionItem* item){ return rpyFromRot(item->position().linear()).z(); },
+            isDescending);
+        break;
+    default:
+        sortItemsByKey(items, [](BodyPositionItem* item){ return item->treeOrderKey(); }, isDescending);
+        break;
+    }
+}
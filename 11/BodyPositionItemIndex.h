@@ -0,0 +1,57 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_INDEX_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_INDEX_H
+
+#include "BodyPositionItem.h"
+#include <cnoid/Signal>
+#include <string>
+#include <vector>
+
+/**
+   This class indexes the body position items in the project by the name, the owner body item
+   and the flag color. The index is updated incrementally when the items are added or removed
+   and when the keys of the items are changed. The flag color of an item whose file is pending
+   is indexed when the file is loaded, and the pending files are loaded when the items are
+   filtered by the flag color.
+*/
+class BodyPositionItemIndex
+{
+public:
+    static BodyPositionItemIndex* instance();
+
+    struct Filter
+    {
+        // The name prefix is compared without distinction of the upper and lower cases
+        std::string namePrefix;
+        cnoid::BodyItem* owner;
+        int flagColor;
+        Filter() : owner(nullptr), flagColor(-1) { }
+        bool isEmpty() const { return namePrefix.empty() && !owner && flagColor < 0; }
+    };
+
+    /**
+       The items are returned in the tree order when the filter is empty. Otherwise they are
+       returned in the order of the index, and sort() with NoSorting puts them in the tree order.
+    */
+    cnoid::ItemList<BodyPositionItem> find(const Filter& filter) const;
+    static bool matches(BodyPositionItem* item, const Filter& filter);
+    std::vector<cnoid::BodyItem*> owners() const;
+
+    enum SortKey { NoSorting, SortByName, SortByFlagHeight, SortByYaw };
+    static void sort(cnoid::ItemList<BodyPositionItem>& items, SortKey key, bool isDescending);
+
+    cnoid::SignalProxy<
+        void(const cnoid::ItemList<BodyPositionItem>& addedItems,
+             const cnoid::ItemList<BodyPositionItem>& removedItems)> sigItemsChanged();
+
+    // This signal is emitted once in an event loop cycle when the keys of the items are changed
+    cnoid::SignalProxy<void()> sigKeysChanged();
+
+private:
+    BodyPositionItemIndex();
+    ~BodyPositionItemIndex();
+
+    class Impl;
+    Impl* impl;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_INDEX_H
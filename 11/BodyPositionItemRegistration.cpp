@@ -22,6 +22,12 @@ class BodyPositionItemCreationPanel : public ItemCreationPanelBase<BodyPositionI
     
 public:
     BodyPositionItemCreationPanel()
+    {
+        nameEntry = nullptr;
+    }
+
+    // The widgets are created when the panel is first used
+    void createWidgets()
     {
         auto vbox = new QVBoxLayout;
         setLayout(vbox);
@@ -53,6 +59,9 @@ public:
 
     virtual bool initializeCreation(BodyPositionItem* protoItem, Item* parentItem) override
     {
+        if(!nameEntry){
+            createWidgets();
+        }
         nameEntry->setText(protoItem->name().c_str());
         return true;
     }
@@ -100,33 +109,13 @@ public:
 
     virtual void storeOptions(Mapping* options) override
     {
-        if(lengthUnit == BodyPositionItem::Millimeter){
-            options->write("length_unit", "millimeter");
-        } else {
-            options->write("length_unit", "meter");
-        }
-        if(angleUnit == BodyPositionItem::Radian){
-            options->write("angle_unit", "radian");
-        } else {
-            options->write("angle_unit", "degree");
-        }
+        options->write("length_unit", BodyPositionItem::lengthUnitSymbol(lengthUnit));
+        options->write("angle_unit", BodyPositionItem::angleUnitSymbol(angleUnit));
     }
 
     virtual bool restoreOptions(const Mapping* options) override
     {
-        string unit;
-        options->read("length_unit", unit);
-        if(unit == "millimeter"){
-            lengthUnit = BodyPositionItem::Millimeter;
-        } else {
-            lengthUnit = BodyPositionItem::Meter;
-        }
-        options->read("angle_unit", unit);
-        if(unit == "radian"){
-            angleUnit = BodyPositionItem::Radian;
-        } else {
-            angleUnit = BodyPositionItem::Degree;
-        }
+        BodyPositionItem::readUnitOptions(options, lengthUnit, angleUnit);
         return true;
     }
 
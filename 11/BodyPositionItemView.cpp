@@ -1,37 +1,297 @@
 #include "BodyPositionItemView.h"
+#include "BodyPositionTrace.h"
 #include <cnoid/RootItem>
 #include <cnoid/ItemList>
 #include <cnoid/EigenUtil>
 #include <cnoid/MenuManager>
 #include <cnoid/Archive>
+#include <QAbstractTableModel>
+#include <QStyledItemDelegate>
+#include <QHeaderView>
+#include <QScrollBar>
+#include <QBoxLayout>
+#include <algorithm>
 
 using namespace std;
 using namespace cnoid;
 
+namespace {
+
+enum ListColumn { NameColumn, HeightColumn, OrientationColumn, StoreColumn, RestoreColumn, NumListColumns };
+
+}
+
+class BodyPositionItemView::ListModel : public QAbstractTableModel
+{
+public:
+    vector<BodyPositionItemPtr> items;
+
+    ListModel(QObject* parent)
+        : QAbstractTableModel(parent)
+    { }
+
+    void setItems(const ItemList<BodyPositionItem>& newItems)
+    {
+        beginResetModel();
+        items.assign(newItems.begin(), newItems.end());
+        endResetModel();
+    }
+
+    BodyPositionItem* item(int row) const
+    {
+        return items[row];
+    }
+
+    void notifyRowUpdate(int row)
+    {
+        dataChanged(index(row, 0), index(row, NumListColumns - 1));
+    }
+
+    virtual int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : items.size();
+    }
+
+    virtual int columnCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : NumListColumns;
+    }
+
+    virtual QVariant data(const QModelIndex& index, int role) const override
+    {
+        if(role == Qt::DisplayRole && index.column() == NameColumn){
+            return QString(items[index.row()]->name().c_str());
+        }
+        return QVariant();
+    }
+
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role) const override
+    {
+        if(role == Qt::DisplayRole && orientation == Qt::Horizontal){
+            switch(section){
+            case NameColumn: return QString("Name");
+            case HeightColumn: return QString("Flag height");
+            case OrientationColumn: return QString("Orientation");
+            default: break;
+            }
+        }
+        return QVariant();
+    }
+
+    virtual Qt::ItemFlags flags(const QModelIndex& /* index */) const override
+    {
+        return Qt::ItemIsEnabled;
+    }
+};
+
+class BodyPositionItemView::ListDelegate : public QStyledItemDelegate
+{
+public:
+    BodyPositionItemView* view;
+
+    ListDelegate(BodyPositionItemView* view)
+        : QStyledItemDelegate(view),
+          view(view)
+    { }
+
+    virtual QWidget* createEditor
+    (QWidget* parent, const QStyleOptionViewItem& /* option */, const QModelIndex& index) const override
+    {
+        BodyPositionItemPtr item = view->listModel->item(index.row());
+        auto v = view;
+
+        switch(index.column()){
+        case HeightColumn: {
+            auto slider = new Slider(Qt::Horizontal, parent);
+            slider->setRange(1, 3000);
+            slider->sigValueChanged().connect(
+                [v, item, slider](int value){
+                    v->onHeightSliderValueChanged(item, value, slider->isSliderDown()); });
+            QObject::connect(slider, &QAbstractSlider::sliderReleased,
+                             [v, item, slider](){ v->onHeightSliderReleased(item, slider->value()); });
+            return slider;
+        }
+        case OrientationColumn: {
+            auto dial = new Dial(parent);
+            dial->setRange(-180, 180);
+            dial->sigValueChanged().connect(
+                [v, item, dial](int value){
+                    v->onOrientationDialValueChanged(item, value, dial->isSliderDown()); });
+            QObject::connect(dial, &QAbstractSlider::sliderReleased,
+                             [v, item, dial](){ v->onOrientationDialReleased(item, dial->value()); });
+            return dial;
+        }
+        case StoreColumn: {
+            auto button = new PushButton("Store", parent);
+            button->sigClicked().connect([v, item](){ v->onStoreButtonClicked(item); });
+            return button;
+        }
+        case RestoreColumn: {
+            auto button = new PushButton("Restore", parent);
+            button->sigClicked().connect([v, item](){ v->onRestoreButtonClicked(item); });
+            return button;
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    virtual void setEditorData(QWidget* editor, const QModelIndex& index) const override
+    {
+        auto item = view->listModel->item(index.row());
+        editor->blockSignals(true);
+        if(index.column() == HeightColumn){
+            static_cast<Slider*>(editor)->setValue(item->flagHeight() * 1000);
+        } else if(index.column() == OrientationColumn){
+            auto rpy = rpyFromRot(item->position().linear());
+            static_cast<Dial*>(editor)->setValue(degree(rpy.z()));
+        }
+        editor->blockSignals(false);
+    }
+
+    // The values are applied to the items by the signals of the editors
+    virtual void setModelData
+    (QWidget* /* editor */, QAbstractItemModel* /* model */, const QModelIndex& /* index */) const override
+    { }
+
+    virtual void updateEditorGeometry
+    (QWidget* editor, const QStyleOptionViewItem& option, const QModelIndex& /* index */) const override
+    {
+        editor->setGeometry(option.rect);
+    }
+};
+
 BodyPositionItemView::BodyPositionItemView()
 {
     setDefaultLayoutArea(BottomCenterArea);
 
-    grid = new QGridLayout;
-    setLayout(grid, 1.0);
+    auto vbox = new QVBoxLayout;
+    index = BodyPositionItemIndex::instance();
+    sortKey = BodyPositionItemIndex::NoSorting;
+    isSortDescending = false;
+    createFilterBar(vbox);
 
-    targetMode = All;
+    rowBox = new QVBoxLayout;
+    firstInterfaceUnit = nullptr;
+    lastInterfaceUnit = nullptr;
+    rowBox->addStretch();
+    vbox->addLayout(rowBox);
+
+    isListMode_ = false;
+    listModel = new ListModel(this);
+    tableView = new QTableView(this);
+    tableView->setModel(listModel);
+    tableView->setItemDelegate(new ListDelegate(this));
+    tableView->setSelectionMode(QAbstractItemView::NoSelection);
+    tableView->verticalHeader()->hide();
+    tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    tableView->verticalHeader()->setDefaultSectionSize(40);
+    auto header = tableView->horizontalHeader();
+    header->setSectionResizeMode(HeightColumn, QHeaderView::Stretch);
+    header->setSectionsClickable(true);
+    header->setSortIndicatorShown(true);
+    header->setSortIndicator(-1, Qt::AscendingOrder);
+    QObject::connect(header, &QHeaderView::sortIndicatorChanged,
+                     [this](int column, Qt::SortOrder order){ onListSortIndicatorChanged(column, order); });
+    tableView->hide();
+    vbox->addWidget(tableView, 1);
+    editorRowBegin = 0;
+    editorRowEnd = 0;
+    auto scrollBar = tableView->verticalScrollBar();
+    QObject::connect(scrollBar, &QScrollBar::valueChanged, [this](int){ updateListEditors(); });
+    QObject::connect(scrollBar, &QScrollBar::rangeChanged, [this](int, int){ updateListEditors(); });
+
+    setLayout(vbox, 1.0);
+
+    targetMode_ = All;
+
+    interfaceUpdater.setFunction([this](){ updateRequestedInterfaces(); });
+}
+
+void BodyPositionItemView::createFilterBar(QBoxLayout* layout)
+{
+    auto hbox = new QHBoxLayout;
+
+    nameFilterEdit = new LineEdit;
+    nameFilterEdit->setPlaceholderText("Name");
+    nameFilterEdit->sigTextChanged().connect(
+        [this](const QString& text){
+            auto newFilter = filter;
+            newFilter.namePrefix = text.toStdString();
+            setFilter(newFilter);
+        });
+    hbox->addWidget(nameFilterEdit, 1);
+
+    ownerCombo = new ComboBox;
+    ownerCombo->addItem("Any owner");
+    ownerCombo->sigCurrentIndexChanged().connect(
+        [this](int which){
+            auto newFilter = filter;
+            newFilter.owner = (which > 0) ? ownerChoices[which - 1].get() : nullptr;
+            setFilter(newFilter);
+        });
+    hbox->addWidget(ownerCombo);
+
+    colorCombo = new ComboBox;
+    colorCombo->addItem("Any color");
+    colorCombo->addItem("Red");
+    colorCombo->addItem("Green");
+    colorCombo->addItem("Blue");
+    colorCombo->sigCurrentIndexChanged().connect(
+        [this](int which){
+            auto newFilter = filter;
+            newFilter.flagColor = which - 1;
+            setFilter(newFilter);
+        });
+    hbox->addWidget(colorCombo);
+
+    sortCombo = new ComboBox;
+    sortCombo->addItem("No sorting");
+    sortCombo->addItem("Name");
+    sortCombo->addItem("Flag height");
+    sortCombo->addItem("Yaw");
+    sortCombo->sigCurrentIndexChanged().connect(
+        [this](int which){
+            setSorting(static_cast<BodyPositionItemIndex::SortKey>(which), isSortDescending); });
+    hbox->addWidget(sortCombo);
+
+    descendingCheck = new CheckBox("Descending");
+    descendingCheck->sigToggled().connect(
+        [this](bool on){ setSorting(sortKey, on); });
+    hbox->addWidget(descendingCheck);
+
+    layout->addLayout(hbox);
 }
 
 void BodyPositionItemView::onActivated()
 {
-    setTargetMode(targetMode);
+    indexConnections.add(
+        index->sigItemsChanged().connect(
+            [this](const ItemList<BodyPositionItem>&, const ItemList<BodyPositionItem>&){
+                updateOwnerCombo(); }));
+    indexConnections.add(
+        index->sigKeysChanged().connect(
+            [this](){
+                updateOwnerCombo();
+                if(isFilteringOrSorting()){
+                    updateTargetItems();
+                }
+            }));
+    updateOwnerCombo();
+    setTargetMode(targetMode_);
 }
 
 void BodyPositionItemView::setTargetMode(TargetMode mode)
 {
-    if(mode != targetMode || !connectionForTargetDetection.connected()){
-        targetMode = mode;
+    if(mode != targetMode_ || !connectionForTargetDetection.connected()){
+        targetMode_ = mode;
         if(isActive()){
             if(mode == All){
                 connectionForTargetDetection =
-                    BodyPositionItem::sigItemsInProjectChanged().connect(
-                        [this](){ updateTargetItems(); });
+                    index->sigItemsChanged().connect(
+                        [this](const ItemList<BodyPositionItem>& addedItems,
+                               const ItemList<BodyPositionItem>& removedItems){
+                            onItemsInProjectChanged(addedItems, removedItems); });
             } else if(mode == Selected){
                 connectionForTargetDetection =
                     RootItem::instance()->sigSelectedItemsChanged().connect(
@@ -45,70 +305,380 @@ void BodyPositionItemView::setTargetMode(TargetMode mode)
 void BodyPositionItemView::onDeactivated()
 {
     connectionForTargetDetection.disconnect();
+    indexConnections.disconnect();
+}
+
+void BodyPositionItemView::setListMode(bool on)
+{
+    if(on != isListMode_){
+        isListMode_ = on;
+        if(on){
+            clearInterfaceUnits();
+            tableView->show();
+        } else {
+            closeAllListRowEditors();
+            listModel->setItems(ItemList<BodyPositionItem>());
+            tableView->hide();
+        }
+        if(isActive()){
+            updateTargetItems();
+        }
+    }
 }
 
 void BodyPositionItemView::updateTargetItems()
 {
+    BodyPositionTrace::Span span("BodyPositionItemView::updateTargetItems");
     ItemList<BodyPositionItem> items;
-    if(targetMode == All){
-        items = RootItem::instance()->descendantItems<BodyPositionItem>();
-    } else if(targetMode == Selected){
-        items = RootItem::instance()->selectedItems<BodyPositionItem>();
+    if(targetMode_ == All){
+        items = index->find(filter);
+    } else if(targetMode_ == Selected){
+        items = BodyPositionItem::selectedRegisteredItems();
+        if(!filter.isEmpty()){
+            items.erase(
+                std::remove_if(items.begin(), items.end(),
+                               [this](BodyPositionItem* item){
+                                   return !BodyPositionItemIndex::matches(item, filter); }),
+                items.end());
+        }
+    }
+    // The items found by the index are put in the tree order by the sorting without a key
+    if(isFilteringOrSorting()){
+        BodyPositionItemIndex::sort(items, sortKey, isSortDescending);
+    }
+
+    if(isListMode_){
+        closeAllListRowEditors();
+        listModel->setItems(items);
+        updateListEditors();
+    } else {
+        updateInterfaceUnits(items);
+    }
+}
+
+void BodyPositionItemView::updateOwnerCombo()
+{
+    auto owners = index->owners();
+    if(owners.size() == ownerChoices.size() &&
+       std::equal(owners.begin(), owners.end(), ownerChoices.begin(),
+                  [](BodyItem* owner, const BodyItemPtr& choice){ return owner == choice; })){
+        return;
+    }
+    int currentIndex = 0;
+    ownerChoices.assign(owners.begin(), owners.end());
+    ownerCombo->blockSignals(true);
+    ownerCombo->clear();
+    ownerCombo->addItem("Any owner");
+    for(size_t i=0; i < owners.size(); ++i){
+        ownerCombo->addItem(owners[i]->name().c_str());
+        if(owners[i] == filter.owner){
+            currentIndex = i + 1;
+        }
+    }
+    ownerCombo->setCurrentIndex(currentIndex);
+    ownerCombo->blockSignals(false);
+
+    // The owner filter is cleared when the owner has no position item any more
+    if(filter.owner && currentIndex == 0){
+        filter.owner = nullptr;
+        if(isActive()){
+            updateTargetItems();
+        }
+    }
+}
+
+void BodyPositionItemView::setFilter(const BodyPositionItemIndex::Filter& newFilter)
+{
+    filter = newFilter;
+    if(isActive()){
+        updateTargetItems();
+    }
+}
+
+void BodyPositionItemView::setSorting(BodyPositionItemIndex::SortKey key, bool isDescending)
+{
+    sortKey = key;
+    isSortDescending = isDescending;
+
+    sortCombo->blockSignals(true);
+    sortCombo->setCurrentIndex(key);
+    sortCombo->blockSignals(false);
+    descendingCheck->blockSignals(true);
+    descendingCheck->setChecked(isDescending);
+    descendingCheck->blockSignals(false);
+
+    int column = -1;
+    switch(key){
+    case BodyPositionItemIndex::SortByName: column = NameColumn; break;
+    case BodyPositionItemIndex::SortByFlagHeight: column = HeightColumn; break;
+    case BodyPositionItemIndex::SortByYaw: column = OrientationColumn; break;
+    default: break;
+    }
+    auto header = tableView->horizontalHeader();
+    header->blockSignals(true);
+    header->setSortIndicator(column, isDescending ? Qt::DescendingOrder : Qt::AscendingOrder);
+    header->blockSignals(false);
+
+    if(isActive()){
+        updateTargetItems();
     }
+}
 
-    size_t prevSize = interfaceUnits.size();
-    interfaceUnits.resize(items.size());
+bool BodyPositionItemView::isFilteringOrSorting() const
+{
+    return !filter.isEmpty() || sortKey != BodyPositionItemIndex::NoSorting || isSortDescending;
+}
 
-    for(size_t i = prevSize; i < interfaceUnits.size(); ++i){
-        auto& unit = interfaceUnits[i];
-        unit.reset(new InterfaceUnit);
+void BodyPositionItemView::onListSortIndicatorChanged(int column, Qt::SortOrder order)
+{
+    BodyPositionItemIndex::SortKey key;
+    switch(column){
+    case NameColumn: key = BodyPositionItemIndex::SortByName; break;
+    case HeightColumn: key = BodyPositionItemIndex::SortByFlagHeight; break;
+    case OrientationColumn: key = BodyPositionItemIndex::SortByYaw; break;
+    default: key = BodyPositionItemIndex::NoSorting; break;
+    }
+    setSorting(key, order == Qt::DescendingOrder);
+}
 
-        unit->nameLabel = new QLabel(this);
+/**
+   The rows of the removed items are removed and the rows of the added items are inserted at the
+   tree positions of the items. The added units are merged into the unit list by the tree order
+   keys, and then the rows are placed in one pass.
+*/
+void BodyPositionItemView::onItemsInProjectChanged
+(const ItemList<BodyPositionItem>& addedItems, const ItemList<BodyPositionItem>& removedItems)
+{
+    BodyPositionTrace::Span span("BodyPositionItemView::onItemsInProjectChanged");
+    if(isListMode_ || isFilteringOrSorting()){
+        updateTargetItems();
+        return;
+    }
+    for(auto& item : removedItems){
+        releaseInterfaceUnit(item);
+    }
+    vector<InterfaceUnit*> addedUnits;
+    for(auto& item : addedItems){
+        if(item->isConnectedToRoot() &&
+           itemToInterfaceUnitMap.find(item) == itemToInterfaceUnitMap.end()){
+            addedUnits.push_back(createInterfaceUnit(item));
+        }
+    }
+    if(addedUnits.empty()){
+        return;
+    }
+    std::sort(addedUnits.begin(), addedUnits.end(),
+              [](InterfaceUnit* unit1, InterfaceUnit* unit2){
+                  return unit1->item->treeOrderKey() < unit2->item->treeOrderKey(); });
+    InterfaceUnit* prevUnit = nullptr;
+    auto unit = firstInterfaceUnit;
+    for(auto& addedUnit : addedUnits){
+        auto key = addedUnit->item->treeOrderKey();
+        while(unit && unit->item->treeOrderKey() < key){
+            prevUnit = unit;
+            unit = unit->nextUnit;
+        }
+        linkInterfaceUnit(addedUnit, prevUnit);
+        prevUnit = addedUnit;
+    }
+    placeRowWidgets();
+}
+
+void BodyPositionItemView::updateInterfaceUnits(const ItemList<BodyPositionItem>& items)
+{
+    for(auto unit = firstInterfaceUnit; unit; unit = unit->nextUnit){
+        unit->isInUse = false;
+    }
+    for(auto& item : items){
+        auto p = itemToInterfaceUnitMap.find(item);
+        if(p != itemToInterfaceUnitMap.end()){
+            p->second->isInUse = true;
+        }
+    }
+    // The units released here are reused for the new items
+    auto unit = firstInterfaceUnit;
+    while(unit){
+        auto nextUnit = unit->nextUnit;
+        if(!unit->isInUse){
+            releaseInterfaceUnit(unit->item);
+        }
+        unit = nextUnit;
+    }
+    firstInterfaceUnit = nullptr;
+    lastInterfaceUnit = nullptr;
+    for(auto& item : items){
+        auto p = itemToInterfaceUnitMap.find(item);
+        if(p != itemToInterfaceUnitMap.end()){
+            linkInterfaceUnit(p->second.get(), lastInterfaceUnit);
+        } else {
+            linkInterfaceUnit(createInterfaceUnit(item), lastInterfaceUnit);
+        }
+    }
+
+    placeRowWidgets();
+}
+
+// Only the rows whose positions have been changed are moved
+void BodyPositionItemView::placeRowWidgets()
+{
+    int rowIndex = 0;
+    for(auto unit = firstInterfaceUnit; unit; unit = unit->nextUnit){
+        auto rowWidget = unit->rowWidget;
+        if(!unit->isRowPlaced){
+            rowBox->insertWidget(rowIndex, rowWidget);
+            unit->isRowPlaced = true;
+        } else if(rowBox->itemAt(rowIndex)->widget() != rowWidget){
+            rowBox->removeWidget(rowWidget);
+            rowBox->insertWidget(rowIndex, rowWidget);
+        }
+        ++rowIndex;
+    }
+}
+
+// The unit is linked at the head when prevUnit is null
+void BodyPositionItemView::linkInterfaceUnit(InterfaceUnit* unit, InterfaceUnit* prevUnit)
+{
+    unit->prevUnit = prevUnit;
+    unit->nextUnit = prevUnit ? prevUnit->nextUnit : firstInterfaceUnit;
+    if(prevUnit){
+        prevUnit->nextUnit = unit;
+    } else {
+        firstInterfaceUnit = unit;
+    }
+    if(unit->nextUnit){
+        unit->nextUnit->prevUnit = unit;
+    } else {
+        lastInterfaceUnit = unit;
+    }
+}
+
+void BodyPositionItemView::unlinkInterfaceUnit(InterfaceUnit* unit)
+{
+    if(unit->prevUnit){
+        unit->prevUnit->nextUnit = unit->nextUnit;
+    } else if(firstInterfaceUnit == unit){
+        firstInterfaceUnit = unit->nextUnit;
+    }
+    if(unit->nextUnit){
+        unit->nextUnit->prevUnit = unit->prevUnit;
+    } else if(lastInterfaceUnit == unit){
+        lastInterfaceUnit = unit->prevUnit;
+    }
+    unit->prevUnit = nullptr;
+    unit->nextUnit = nullptr;
+}
+
+BodyPositionItemView::InterfaceUnit* BodyPositionItemView::createInterfaceUnit(BodyPositionItem* item)
+{
+    auto& unitPtr = itemToInterfaceUnitMap[item];
+
+    // A unit released before is rebound to the item without creating the widgets
+    if(!interfaceUnitPool.empty()){
+        unitPtr = std::move(interfaceUnitPool.back());
+        interfaceUnitPool.pop_back();
+    } else {
+        unitPtr.reset(new InterfaceUnit);
+        createInterfaceWidgets(unitPtr.get());
+    }
+    auto unit = unitPtr.get();
+    unit->item = item;
+    unit->isInterfaceUpdateRequested = false;
+    unit->isInUse = true;
+    unit->isRowPlaced = false;
+    unit->prevUnit = nullptr;
+    unit->nextUnit = nullptr;
+    unit->nameLabel->setText(item->name().c_str());
+
+    unit->itemConnections.add(
+        item->sigUpdated().connect(
+            [=](){ updateInterfaceLater(unit); }));
+    unit->itemConnections.add(
+        item->sigNameChanged().connect(
+            [=](const std::string&){ unit->nameLabel->setText(unit->item->name().c_str()); }));
+
+    updateInterface(unit);
+    unit->rowWidget->show();
+
+    return unit;
+}
+
+void BodyPositionItemView::createInterfaceWidgets(InterfaceUnit* unit)
+{
+    unit->rowWidget = new QWidget(this);
+    auto hbox = new QHBoxLayout;
+    hbox->setContentsMargins(0, 0, 0, 0);
+    unit->rowWidget->setLayout(hbox);
+
+    unit->nameLabel = new QLabel;
+    unit->nameLabel->setMinimumWidth(120);
+    hbox->addWidget(unit->nameLabel);
         
-        unit->heightSlider = new Slider(Qt::Horizontal, this);
-        unit->heightSlider->setRange(1, 3000);
-        unit->connections.add(
-            unit->heightSlider->sigValueChanged().connect(
-                [=](int value){ onHeightSliderValueChanged(i, value); }));
-
-        unit->orientationDial = new Dial(this);
-        unit->orientationDial->setRange(-180, 180);
-        unit->connections.add(
-            unit->orientationDial->sigValueChanged().connect(
-                [=](int value){ onOrientationDialValueChanged(i, value); }));
-
-        unit->storeButton = new PushButton("Store", this);
-        unit->storeButton->sigClicked().connect(
-            [=](){ onStoreButtonClicked(i); });
+    unit->heightSlider = new Slider(Qt::Horizontal);
+    unit->heightSlider->setRange(1, 3000);
+    unit->connections.add(
+        unit->heightSlider->sigValueChanged().connect(
+            [=](int value){
+                onHeightSliderValueChanged(unit->item, value, unit->heightSlider->isSliderDown()); }));
+    QObject::connect(unit->heightSlider, &QAbstractSlider::sliderReleased,
+                     [=](){ onHeightSliderReleased(unit->item, unit->heightSlider->value()); });
+    hbox->addWidget(unit->heightSlider, 1);
+
+    unit->orientationDial = new Dial;
+    unit->orientationDial->setRange(-180, 180);
+    unit->connections.add(
+        unit->orientationDial->sigValueChanged().connect(
+            [=](int value){
+                onOrientationDialValueChanged(unit->item, value, unit->orientationDial->isSliderDown()); }));
+    QObject::connect(unit->orientationDial, &QAbstractSlider::sliderReleased,
+                     [=](){ onOrientationDialReleased(unit->item, unit->orientationDial->value()); });
+    hbox->addWidget(unit->orientationDial);
+
+    unit->storeButton = new PushButton("Store");
+    unit->storeButton->sigClicked().connect(
+        [=](){ onStoreButtonClicked(unit->item); });
+    hbox->addWidget(unit->storeButton);
         
-        unit->restoreButton = new PushButton("Restore", this);
-        unit->restoreButton->sigClicked().connect(
-            [=](){ onRestoreButtonClicked(i); });
+    unit->restoreButton = new PushButton("Restore");
+    unit->restoreButton->sigClicked().connect(
+        [=](){ onRestoreButtonClicked(unit->item); });
+    hbox->addWidget(unit->restoreButton);
+}
 
-        grid->addWidget(unit->nameLabel, i, 0);
-        grid->addWidget(unit->heightSlider, i, 1);
-        grid->addWidget(unit->orientationDial, i, 2);
-        grid->addWidget(unit->storeButton, i, 3);
-        grid->addWidget(unit->restoreButton, i, 4);
+void BodyPositionItemView::releaseInterfaceUnit(BodyPositionItem* item)
+{
+    auto p = itemToInterfaceUnitMap.find(item);
+    if(p != itemToInterfaceUnitMap.end()){
+        auto unit = p->second.get();
+        if(unit->isInterfaceUpdateRequested){
+            interfaceUnitsToUpdate.erase(
+                std::find(interfaceUnitsToUpdate.begin(), interfaceUnitsToUpdate.end(), unit));
+            unit->isInterfaceUpdateRequested = false;
+        }
+        unlinkInterfaceUnit(unit);
+        unit->itemConnections.disconnect();
+        unit->item.reset();
+        rowBox->removeWidget(unit->rowWidget);
+        unit->isRowPlaced = false;
+        unit->rowWidget->hide();
+        interfaceUnitPool.push_back(std::move(p->second));
+        itemToInterfaceUnitMap.erase(p);
     }
+}
 
-    itemConnections.disconnect();
-    for(size_t i =0; i < items.size(); ++i){
-        auto& item = items[i];
-        auto& unit = interfaceUnits[i];
-        unit->item = item;
-        unit->nameLabel->setText(item->name().c_str());
-        itemConnections.add(
-            item->sigUpdated().connect(
-                [=](){ updateInterface(i); }));
-        updateInterface(i);
-    }
+// The pooled units are also deleted because the list mode does not use them
+void BodyPositionItemView::clearInterfaceUnits()
+{
+    firstInterfaceUnit = nullptr;
+    lastInterfaceUnit = nullptr;
+    interfaceUnitsToUpdate.clear();
+    itemToInterfaceUnitMap.clear();
+    interfaceUnitPool.clear();
 }
 
-void BodyPositionItemView::updateInterface(int index)
+void BodyPositionItemView::updateInterface(InterfaceUnit* unit)
 {
-    auto& unit = interfaceUnits[index];
     auto& item = unit->item;
+    item->ensureLoaded();
     unit->connections.block();
     unit->heightSlider->setValue(item->flagHeight() * 1000);
     auto rpy = rpyFromRot(item->position().linear());
@@ -116,14 +686,109 @@ void BodyPositionItemView::updateInterface(int index)
     unit->connections.unblock();
 }
 
-void BodyPositionItemView::onHeightSliderValueChanged(int index, int value)
+// The updates of many items in an event loop cycle are processed together
+void BodyPositionItemView::updateInterfaceLater(InterfaceUnit* unit)
+{
+    if(!unit->isInterfaceUpdateRequested){
+        unit->isInterfaceUpdateRequested = true;
+        interfaceUnitsToUpdate.push_back(unit);
+        interfaceUpdater();
+    }
+}
+
+void BodyPositionItemView::updateRequestedInterfaces()
+{
+    BodyPositionTrace::Span span("BodyPositionItemView::updateRequestedInterfaces");
+    for(auto& unit : interfaceUnitsToUpdate){
+        unit->isInterfaceUpdateRequested = false;
+        updateInterface(unit);
+    }
+    interfaceUnitsToUpdate.clear();
+}
+
+void BodyPositionItemView::updateListEditors()
+{
+    BodyPositionTrace::Span span("BodyPositionItemView::updateListEditors");
+    int numRows = listModel->rowCount();
+    int newBegin = 0;
+    int newEnd = 0;
+    // No editor is opened when the viewport has no room for a row
+    int height = tableView->viewport()->height();
+    int first = (height > 0) ? tableView->rowAt(0) : -1;
+    if(numRows > 0 && first >= 0){
+        newBegin = first;
+        int last = tableView->rowAt(height - 1);
+        newEnd = (last < 0) ? numRows : last + 1;
+    }
+    for(int row = editorRowBegin; row < editorRowEnd; ++row){
+        if(row < newBegin || row >= newEnd){
+            closeListRowEditors(row);
+        }
+    }
+    for(int row = newBegin; row < newEnd; ++row){
+        if(row < editorRowBegin || row >= editorRowEnd){
+            openListRowEditors(row);
+        }
+    }
+    editorRowBegin = newBegin;
+    editorRowEnd = newEnd;
+}
+
+void BodyPositionItemView::openListRowEditors(int row)
+{
+    listModel->item(row)->ensureLoaded();
+    for(int column = HeightColumn; column < NumListColumns; ++column){
+        tableView->openPersistentEditor(listModel->index(row, column));
+    }
+    auto item = listModel->item(row);
+    auto& connections = listRowConnections[row];
+    connections.add(
+        item->sigUpdated().connect(
+            [this, row](){ listModel->notifyRowUpdate(row); }));
+    connections.add(
+        item->sigNameChanged().connect(
+            [this, row](const std::string&){ listModel->notifyRowUpdate(row); }));
+}
+
+void BodyPositionItemView::closeListRowEditors(int row)
+{
+    for(int column = HeightColumn; column < NumListColumns; ++column){
+        tableView->closePersistentEditor(listModel->index(row, column));
+    }
+    auto p = listRowConnections.find(row);
+    if(p != listRowConnections.end()){
+        p->second.disconnect();
+        listRowConnections.erase(p);
+    }
+}
+
+void BodyPositionItemView::closeAllListRowEditors()
+{
+    for(int row = editorRowBegin; row < editorRowEnd; ++row){
+        closeListRowEditors(row);
+    }
+    editorRowBegin = 0;
+    editorRowEnd = 0;
+}
+
+// Only the flag in the scene is updated while the slider or dial is being dragged
+void BodyPositionItemView::onHeightSliderValueChanged(BodyPositionItem* item, int value, bool isDragging)
 {
-    interfaceUnits[index]->item->setFlagHeight(value / 1000.0);
+    if(isDragging){
+        item->previewFlagHeight(value / 1000.0);
+        return;
+    }
+    item->cancelFlagPreview();
+    item->setFlagHeight(value / 1000.0);
 }
 
-void BodyPositionItemView::onOrientationDialValueChanged(int index, int value)
+void BodyPositionItemView::onOrientationDialValueChanged(BodyPositionItem* item, int value, bool isDragging)
 {
-    auto item = interfaceUnits[index]->item;
+    if(isDragging){
+        item->previewFlagOrientation(radian(value));
+        return;
+    }
+    item->cancelFlagPreview();
     auto T = item->position();
     auto rpy = rpyFromRot(T.linear());
     rpy.z() = radian(value);
@@ -131,28 +796,61 @@ void BodyPositionItemView::onOrientationDialValueChanged(int index, int value)
     item->setPosition(T);
 }
 
-void BodyPositionItemView::onStoreButtonClicked(int index)
+/**
+   The value dragged is committed on the release regardless of the preview because the flag is
+   not previewed when the scene of the item has not been created. The value is compared with the
+   value shown for the item in the same way as updateInterface.
+*/
+void BodyPositionItemView::onHeightSliderReleased(BodyPositionItem* item, int value)
+{
+    if(value != static_cast<int>(item->flagHeight() * 1000)){
+        onHeightSliderValueChanged(item, value, false);
+    } else {
+        item->cancelFlagPreview();
+    }
+}
+
+void BodyPositionItemView::onOrientationDialReleased(BodyPositionItem* item, int value)
 {
-    interfaceUnits[index]->item->storeBodyPosition();
+    auto rpy = rpyFromRot(item->position().linear());
+    if(value != static_cast<int>(degree(rpy.z()))){
+        onOrientationDialValueChanged(item, value, false);
+    } else {
+        item->cancelFlagPreview();
+    }
+}
+
+void BodyPositionItemView::onStoreButtonClicked(BodyPositionItem* item)
+{
+    item->storeBodyPosition();
 }
 
-void BodyPositionItemView::onRestoreButtonClicked(int index)
+void BodyPositionItemView::onRestoreButtonClicked(BodyPositionItem* item)
 {
-    interfaceUnits[index]->item->restoreBodyPosition();
+    item->restoreBodyPosition();
 }
 
 void BodyPositionItemView::onAttachedMenuRequest(cnoid::MenuManager& menuManager)
 {
     auto modeCheck = menuManager.addCheckItem("Selected body position items only");
-    modeCheck->setChecked(targetMode == Selected);
+    modeCheck->setChecked(targetMode_ == Selected);
     modeCheck->sigToggled().connect(
         [this](bool on){ setTargetMode(on ? Selected : All); });
+    auto listModeCheck = menuManager.addCheckItem("Virtualized list");
+    listModeCheck->setChecked(isListMode_);
+    listModeCheck->sigToggled().connect(
+        [this](bool on){ setListMode(on); });
     menuManager.addSeparator();
 }
 
 bool BodyPositionItemView::storeState(cnoid::Archive& archive)
 {
-    archive.write("target_mode", (targetMode == All) ? "all" : "selected");
+    archive.write("target_mode", (targetMode_ == All) ? "all" : "selected");
+    archive.write("virtualized_list", isListMode_);
+    archive.write("name_filter", filter.namePrefix);
+    archive.write("flag_color_filter", filter.flagColor);
+    archive.write("sort_key", sortCombo->currentIndex());
+    archive.write("sort_descending", isSortDescending);
     return true;
 }
 
@@ -166,14 +864,16 @@ bool BodyPositionItemView::restoreState(const cnoid::Archive& archive)
             setTargetMode(Selected);
         }
     }
+    setListMode(archive.get("virtualized_list", false));
+    nameFilterEdit->setText(archive.get("name_filter", string()).c_str());
+    colorCombo->setCurrentIndex(archive.get("flag_color_filter", -1) + 1);
+    setSorting(static_cast<BodyPositionItemIndex::SortKey>(archive.get("sort_key", 0)),
+               archive.get("sort_descending", false));
     return true;
 }
 
 BodyPositionItemView::InterfaceUnit::~InterfaceUnit()
 {
-    delete nameLabel;
-    delete heightSlider;
-    delete orientationDial;
-    delete storeButton;
-    delete restoreButton;
+    itemConnections.disconnect();
+    delete rowWidget;
 }
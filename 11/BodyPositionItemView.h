@@ -2,14 +2,22 @@
 #define DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_VIEW_H
 
 #include "BodyPositionItem.h"
+#include "BodyPositionItemIndex.h"
 #include <cnoid/View>
 #include <cnoid/ConnectionSet>
 #include <cnoid/Slider>
 #include <cnoid/Dial>
 #include <cnoid/Buttons>
+#include <cnoid/LineEdit>
+#include <cnoid/ComboBox>
+#include <cnoid/CheckBox>
+#include <cnoid/LazyCaller>
 #include <QLabel>
-#include <QGridLayout>
+#include <QBoxLayout>
+#include <QTableView>
 #include <vector>
+#include <map>
+#include <unordered_map>
 #include <memory>
 
 class BodyPositionItemView : public cnoid::View
@@ -17,6 +25,15 @@ class BodyPositionItemView : public cnoid::View
 public:
     BodyPositionItemView();
 
+    enum TargetMode { All, Selected };
+    void setTargetMode(TargetMode mode);
+    TargetMode targetMode() const { return targetMode_; }
+    void setListMode(bool on);
+    bool isListMode() const { return isListMode_; }
+    void updateTargetItems();
+    // The rows are created again in the next update
+    void clearInterfaceUnits();
+
 protected:
     virtual void onActivated() override;
     virtual void onDeactivated() override;
@@ -25,35 +42,93 @@ protected:
     virtual bool restoreState(const cnoid::Archive& archive) override;
 
 private:
-    enum TargetMode { All, Selected };
-    void setTargetMode(TargetMode mode);
-    void updateTargetItems();
-    void updateInterface(int index);
-    void onHeightSliderValueChanged(int index, int value);
-    void onOrientationDialValueChanged(int index, int value);
-    void onStoreButtonClicked(int index);
-    void onRestoreButtonClicked(int index);
-    
-    TargetMode targetMode;
-    cnoid::Connection connectionForTargetDetection;
-    cnoid::ScopedConnectionSet itemConnections;
+    void createFilterBar(QBoxLayout* layout);
+    void updateOwnerCombo();
+    void setFilter(const BodyPositionItemIndex::Filter& newFilter);
+    void setSorting(BodyPositionItemIndex::SortKey key, bool isDescending);
+    bool isFilteringOrSorting() const;
+    void onListSortIndicatorChanged(int column, Qt::SortOrder order);
+    void onItemsInProjectChanged(
+        const cnoid::ItemList<BodyPositionItem>& addedItems,
+        const cnoid::ItemList<BodyPositionItem>& removedItems);
 
     struct InterfaceUnit
     {
         BodyPositionItemPtr item;
+        QWidget* rowWidget;
         QLabel* nameLabel;
         cnoid::Slider* heightSlider;
         cnoid::Dial* orientationDial;
         cnoid::PushButton* storeButton;
         cnoid::PushButton* restoreButton;
         cnoid::ConnectionSet connections;
+        cnoid::ConnectionSet itemConnections;
+        bool isInterfaceUpdateRequested;
+        bool isInUse;
+        bool isRowPlaced;
+        // The units are linked in the order of the rows
+        InterfaceUnit* prevUnit;
+        InterfaceUnit* nextUnit;
 
         ~InterfaceUnit();
     };
 
-    std::vector<std::unique_ptr<InterfaceUnit>> interfaceUnits;
+    void updateInterfaceUnits(const cnoid::ItemList<BodyPositionItem>& items);
+    void placeRowWidgets();
+    InterfaceUnit* createInterfaceUnit(BodyPositionItem* item);
+    void createInterfaceWidgets(InterfaceUnit* unit);
+    void releaseInterfaceUnit(BodyPositionItem* item);
+    void linkInterfaceUnit(InterfaceUnit* unit, InterfaceUnit* prevUnit);
+    void unlinkInterfaceUnit(InterfaceUnit* unit);
+    void updateInterface(InterfaceUnit* unit);
+    void updateInterfaceLater(InterfaceUnit* unit);
+    void updateRequestedInterfaces();
+    void updateListEditors();
+    void openListRowEditors(int row);
+    void closeListRowEditors(int row);
+    void closeAllListRowEditors();
+    void onHeightSliderValueChanged(BodyPositionItem* item, int value, bool isDragging);
+    void onOrientationDialValueChanged(BodyPositionItem* item, int value, bool isDragging);
+    void onHeightSliderReleased(BodyPositionItem* item, int value);
+    void onOrientationDialReleased(BodyPositionItem* item, int value);
+    void onStoreButtonClicked(BodyPositionItem* item);
+    void onRestoreButtonClicked(BodyPositionItem* item);
     
-    QGridLayout* grid;
+    TargetMode targetMode_;
+    cnoid::Connection connectionForTargetDetection;
+
+    // The items in the all mode are found by the index when a filter is specified
+    BodyPositionItemIndex* index;
+    BodyPositionItemIndex::Filter filter;
+    BodyPositionItemIndex::SortKey sortKey;
+    bool isSortDescending;
+    cnoid::ScopedConnectionSet indexConnections;
+    cnoid::LineEdit* nameFilterEdit;
+    cnoid::ComboBox* ownerCombo;
+    cnoid::ComboBox* colorCombo;
+    cnoid::ComboBox* sortCombo;
+    cnoid::CheckBox* descendingCheck;
+    std::vector<cnoid::BodyItemPtr> ownerChoices;
+
+    // The units are owned by the map and the linked list keeps the order of the rows
+    std::unordered_map<BodyPositionItem*, std::unique_ptr<InterfaceUnit>> itemToInterfaceUnitMap;
+    InterfaceUnit* firstInterfaceUnit;
+    InterfaceUnit* lastInterfaceUnit;
+    std::vector<InterfaceUnit*> interfaceUnitsToUpdate;
+    // The released units are kept hidden and reused for other items
+    std::vector<std::unique_ptr<InterfaceUnit>> interfaceUnitPool;
+    cnoid::LazyCaller interfaceUpdater;
+    QVBoxLayout* rowBox;
+
+    // In the list mode, only the rows in the visible area have the editor widgets
+    class ListModel;
+    class ListDelegate;
+    bool isListMode_;
+    ListModel* listModel;
+    QTableView* tableView;
+    int editorRowBegin;
+    int editorRowEnd;
+    std::map<int, cnoid::ConnectionSet> listRowConnections;
 };
 
 #endif // DEVGUIDE_PLUGIN_BODY_POSITION_ITEM_VIEW_H
@@ -0,0 +1,303 @@
+#include "BodyPositionKeyframePlayer.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/RootItem>
+#include <cnoid/BodyItem>
+#include <cnoid/TimeBar>
+#include <cnoid/ConnectionSet>
+#include <QInputDialog>
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// The translation in a segment is a + b s + c s^2 + d s^3, where s is the time from the key
+struct Segment
+{
+    Vector3 a;
+    Vector3 b;
+    Vector3 c;
+    Vector3 d;
+};
+
+struct Track
+{
+    BodyItemPtr bodyItem;
+    vector<double> times;
+    vector<Segment> segments;
+    vector<Quaternion> rotations;
+    Vector3 firstTranslation;
+    bool isDirty;
+    ScopedConnection subTreeConnection;
+    ScopedConnectionSet keyframeConnections;
+};
+
+/**
+   The second derivatives of the natural cubic spline are solved with the tridiagonal
+   matrix algorithm, and the coefficients of the segments are computed from them.
+*/
+void computeSplineSegments
+(const vector<double>& times, const vector<Vector3>& translations, vector<Segment>& out_segments)
+{
+    int n = times.size();
+    out_segments.resize(n - 1);
+    if(n == 2){
+        double h = times[1] - times[0];
+        auto& segment = out_segments[0];
+        segment.a = translations[0];
+        segment.b = (translations[1] - translations[0]) / h;
+        segment.c.setZero();
+        segment.d.setZero();
+        return;
+    }
+    vector<Vector3> m(n, Vector3::Zero());
+    vector<double> diag(n, 1.0);
+    vector<Vector3> rhs(n, Vector3::Zero());
+    for(int i=1; i < n - 1; ++i){
+        double h0 = times[i] - times[i - 1];
+        double h1 = times[i + 1] - times[i];
+        diag[i] = 2.0 * (h0 + h1);
+        rhs[i] = 6.0 * ((translations[i + 1] - translations[i]) / h1 - (translations[i] - translations[i - 1]) / h0);
+    }
+    // Forward elimination of the lower diagonal. The first row is m0 = 0.
+    for(int i=2; i < n - 1; ++i){
+        double h0 = times[i] - times[i - 1];
+        double w = h0 / diag[i - 1];
+        diag[i] -= w * h0;
+        rhs[i] -= w * rhs[i - 1];
+    }
+    for(int i = n - 2; i >= 1; --i){
+        double h1 = times[i + 1] - times[i];
+        m[i] = (rhs[i] - h1 * m[i + 1]) / diag[i];
+    }
+    for(int i=0; i < n - 1; ++i){
+        double h = times[i + 1] - times[i];
+        auto& segment = out_segments[i];
+        segment.a = translations[i];
+        segment.b = (translations[i + 1] - translations[i]) / h - h * (2.0 * m[i] + m[i + 1]) / 6.0;
+        segment.c = m[i] / 2.0;
+        segment.d = (m[i + 1] - m[i]) / (6.0 * h);
+    }
+}
+
+}
+
+class BodyPositionKeyframePlayer::Impl
+{
+public:
+    bool isEnabled;
+    double keyInterval;
+    vector<unique_ptr<Track>> tracks;
+    ScopedConnection selectionConnection;
+    ScopedConnection timeConnection;
+
+    Impl();
+    void setEnabled(bool on);
+    void updateTargetBodyItems();
+    Track* findTrack(BodyItem* bodyItem);
+    void updateTrack(Track* track);
+    bool getPosition(Track* track, double time, Isometry3& out_T);
+    bool onTimeChanged(double time);
+};
+
+BodyPositionKeyframePlayer* BodyPositionKeyframePlayer::instance()
+{
+    static BodyPositionKeyframePlayer player;
+    return &player;
+}
+
+BodyPositionKeyframePlayer::BodyPositionKeyframePlayer()
+{
+    impl = new Impl;
+}
+
+BodyPositionKeyframePlayer::Impl::Impl()
+{
+    isEnabled = false;
+    keyInterval = 1.0;
+}
+
+BodyPositionKeyframePlayer::~BodyPositionKeyframePlayer()
+{
+    delete impl;
+}
+
+void BodyPositionKeyframePlayer::setEnabled(bool on)
+{
+    impl->setEnabled(on);
+}
+
+void BodyPositionKeyframePlayer::Impl::setEnabled(bool on)
+{
+    if(on == isEnabled){
+        return;
+    }
+    isEnabled = on;
+    if(on){
+        selectionConnection =
+            RootItem::instance()->sigSelectedItemsChanged().connect(
+                [this](const ItemList<>&){ updateTargetBodyItems(); });
+        timeConnection =
+            TimeBar::instance()->sigTimeChanged().connect(
+                [this](double time){ return onTimeChanged(time); });
+        updateTargetBodyItems();
+        onTimeChanged(TimeBar::instance()->time());
+    } else {
+        selectionConnection.disconnect();
+        timeConnection.disconnect();
+        tracks.clear();
+    }
+}
+
+bool BodyPositionKeyframePlayer::isEnabled() const
+{
+    return impl->isEnabled;
+}
+
+void BodyPositionKeyframePlayer::setKeyInterval(double interval)
+{
+    if(interval > 0.0 && interval != impl->keyInterval){
+        impl->keyInterval = interval;
+        for(auto& track : impl->tracks){
+            track->isDirty = true;
+        }
+    }
+}
+
+double BodyPositionKeyframePlayer::keyInterval() const
+{
+    return impl->keyInterval;
+}
+
+// The dialog is created only when the interval is edited
+void BodyPositionKeyframePlayer::setKeyIntervalWithDialog()
+{
+    auto player = instance();
+    bool ok;
+    double interval =
+        QInputDialog::getDouble(
+            nullptr, "Keyframe Interval", "Key interval [s]",
+            player->keyInterval(), 0.01, 60.0, 2, &ok);
+    if(ok){
+        player->setKeyInterval(interval);
+    }
+}
+
+// The tracks of the body items that are still selected are kept
+void BodyPositionKeyframePlayer::Impl::updateTargetBodyItems()
+{
+    vector<unique_ptr<Track>> newTracks;
+    for(auto& bodyItem : RootItem::instance()->selectedItems<BodyItem>()){
+        auto p = find_if(tracks.begin(), tracks.end(),
+                         [&](const unique_ptr<Track>& track){ return track && track->bodyItem == bodyItem; });
+        if(p != tracks.end()){
+            newTracks.push_back(std::move(*p));
+        } else {
+            auto track = new Track;
+            track->bodyItem = bodyItem;
+            track->isDirty = true;
+            track->subTreeConnection =
+                bodyItem->sigSubTreeChanged().connect(
+                    [track](){ track->isDirty = true; });
+            newTracks.emplace_back(track);
+        }
+    }
+    tracks = std::move(newTracks);
+}
+
+Track* BodyPositionKeyframePlayer::Impl::findTrack(BodyItem* bodyItem)
+{
+    for(auto& track : tracks){
+        if(track->bodyItem == bodyItem){
+            return track.get();
+        }
+    }
+    return nullptr;
+}
+
+void BodyPositionKeyframePlayer::Impl::updateTrack(Track* track)
+{
+    BodyPositionTrace::Span span("BodyPositionKeyframePlayer::updateTrack");
+
+    track->isDirty = false;
+    track->times.clear();
+    track->segments.clear();
+    track->rotations.clear();
+    track->keyframeConnections.disconnect();
+
+    vector<Vector3> translations;
+    for(auto& item : track->bodyItem->descendantItems<BodyPositionItem>()){
+        if(item->ownerBodyItem() != track->bodyItem){
+            continue;
+        }
+        item->ensureLoaded();
+        track->times.push_back(track->times.size() * keyInterval);
+        translations.push_back(item->translation());
+        // The quaternions are aligned to the previous ones so that slerp takes the shorter arc
+        Quaternion q = item->rotation();
+        if(!track->rotations.empty() && q.dot(track->rotations.back()) < 0.0){
+            q.coeffs() = -q.coeffs();
+        }
+        track->rotations.push_back(q);
+        track->keyframeConnections.add(
+            item->sigUpdated().connect(
+                [track](){ track->isDirty = true; }));
+    }
+    if(translations.size() == 1){
+        track->firstTranslation = translations.front();
+    } else if(translations.size() >= 2){
+        computeSplineSegments(track->times, translations, track->segments);
+    }
+}
+
+bool BodyPositionKeyframePlayer::getPosition(cnoid::BodyItem* bodyItem, double time, cnoid::Isometry3& out_T)
+{
+    auto track = impl->findTrack(bodyItem);
+    return track ? impl->getPosition(track, time, out_T) : false;
+}
+
+bool BodyPositionKeyframePlayer::Impl::getPosition(Track* track, double time, Isometry3& out_T)
+{
+    if(track->isDirty){
+        updateTrack(track);
+    }
+    auto& times = track->times;
+    int n = times.size();
+    if(n == 0){
+        return false;
+    }
+    if(n == 1){
+        out_T.linear() = track->rotations.front().toRotationMatrix();
+        out_T.translation() = track->firstTranslation;
+        return true;
+    }
+    time = std::max(times.front(), std::min(time, times.back()));
+    int i = upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+    i = std::max(0, std::min(i, n - 2));
+    double s = time - times[i];
+    auto& segment = track->segments[i];
+    out_T.translation() = segment.a + s * (segment.b + s * (segment.c + s * segment.d));
+    double u = s / (times[i + 1] - times[i]);
+    out_T.linear() = track->rotations[i].slerp(u, track->rotations[i + 1]).toRotationMatrix();
+    return true;
+}
+
+bool BodyPositionKeyframePlayer::Impl::onTimeChanged(double time)
+{
+    BodyPositionTrace::Span span("BodyPositionKeyframePlayer::onTimeChanged");
+    bool isActive = false;
+    Isometry3 T;
+    for(auto& track : tracks){
+        if(getPosition(track.get(), time, T)){
+            auto bodyItem = track->bodyItem;
+            bodyItem->body()->rootLink()->position() = T;
+            bodyItem->notifyKinematicStateChange(true);
+            if(time < track->times.back()){
+                isActive = true;
+            }
+        }
+    }
+    return isActive;
+}
@@ -0,0 +1,37 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_KEYFRAME_PLAYER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_KEYFRAME_PLAYER_H
+
+#include "BodyPositionItem.h"
+
+/**
+   This class plays the body position items of the selected body items as keyframes on the
+   time bar. The items owned by a body item are the keyframes in the order of the item tree,
+   and the key times are spaced by the key interval from time zero.
+
+   The translation is interpolated with a natural cubic spline and the rotation is interpolated
+   with slerp. The coefficients of the splines are computed into contiguous arrays when the
+   keyframes are changed, so a time change only looks up the segment and evaluates it.
+*/
+class BodyPositionKeyframePlayer
+{
+public:
+    static BodyPositionKeyframePlayer* instance();
+
+    void setEnabled(bool on);
+    bool isEnabled() const;
+    void setKeyInterval(double interval);
+    double keyInterval() const;
+    static void setKeyIntervalWithDialog();
+
+    // Returns false if the body item does not have any keyframe
+    bool getPosition(cnoid::BodyItem* bodyItem, double time, cnoid::Isometry3& out_T);
+
+private:
+    BodyPositionKeyframePlayer();
+    ~BodyPositionKeyframePlayer();
+
+    class Impl;
+    Impl* impl;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_KEYFRAME_PLAYER_H
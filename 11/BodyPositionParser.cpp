@@ -0,0 +1,417 @@
+#include "BodyPositionParser.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/YAMLReader>
+#include <cnoid/EigenArchive>
+#include <fmt/format.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <charconv>
+#include <sstream>
+#include <locale>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// Files larger than this are read with YAMLReader
+const size_t MaxFastParseFileSize = 4096;
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+    while(p < end && isSpace(*p)){
+        ++p;
+    }
+    return p;
+}
+
+inline bool matchKey(const char* begin, const char* end, const char* key)
+{
+    size_t n = std::strlen(key);
+    return (size_t)(end - begin) == n && std::strncmp(begin, key, n) == 0;
+}
+
+}
+
+BodyPositionParser::BodyPositionParser()
+{
+    clear();
+}
+
+void BodyPositionParser::clear()
+{
+    hasTranslation = false;
+    hasRotation = false;
+    hasFlagHeight = false;
+    hasFlagColor = false;
+    translation.setZero();
+    rotation.setZero();
+    flagHeight = 0.0;
+    flagColor.clear();
+    errorMessage_.clear();
+    errorLine_ = 0;
+    errorColumn_ = 0;
+    parsedSize_ = 0;
+}
+
+bool BodyPositionParser::load(const std::string& filename)
+{
+    auto result = parseFile(filename);
+    if(result == Unrecognized){
+        return loadWithYAMLReader(filename);
+    }
+    return result == Parsed;
+}
+
+BodyPositionParser::Result BodyPositionParser::parseFile(const std::string& filename)
+{
+    BodyPositionTrace::Span span("BodyPositionParser::parseFile");
+    clear();
+
+    char buf[MaxFastParseFileSize + 1];
+    auto fp = std::fopen(filename.c_str(), "rb");
+    if(!fp){
+        errorMessage_ = fmt::format("\"{0}\" cannot be opened.", filename);
+        return Error;
+    }
+    size_t size = std::fread(buf, 1, sizeof(buf), fp);
+    bool failed = std::ferror(fp);
+    std::fclose(fp);
+    if(failed){
+        errorMessage_ = fmt::format("\"{0}\" cannot be read.", filename);
+        return Error;
+    }
+    if(size > MaxFastParseFileSize){
+        return Unrecognized;
+    }
+    buf[size] = '\0';
+
+    auto result = parse(buf, size);
+    if(result == Error){
+        errorMessage_ = fmt::format("{0}:{1}:{2}: {3}", filename, errorLine_, errorColumn_, errorMessage_);
+    }
+    return result;
+}
+
+/**
+   The grammar accepted here is a top level block mapping of the four keys, each of which
+   has a single line flow sequence of three numbers or a scalar value. Comments, blank lines
+   and document markers are skipped. Other YAML constructs result in Unrecognized.
+*/
+BodyPositionParser::Result BodyPositionParser::parse(const char* text, size_t size)
+{
+    clear();
+
+    const char* p = text;
+    const char* end = text + size;
+    if(size >= 3 && std::strncmp(p, "\xEF\xBB\xBF", 3) == 0){
+        p += 3;
+    }
+    currentLine = 0;
+    bool isContentFound = false;
+
+    while(p < end){
+        ++currentLine;
+        currentLineBegin = p;
+        auto lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if(!lineEnd){
+            lineEnd = end;
+        }
+        auto next = (lineEnd < end) ? lineEnd + 1 : end;
+        if(lineEnd > p && *(lineEnd - 1) == '\r'){
+            --lineEnd;
+        }
+
+        auto q = skipSpaces(p, lineEnd);
+        if(q == lineEnd || *q == '#'){
+            p = next;
+            continue;
+        }
+        if(q != p){
+            return Unrecognized;
+        }
+        if(lineEnd - p >= 3 && (std::strncmp(p, "---", 3) == 0 || std::strncmp(p, "...", 3) == 0)){
+            if(isContentFound || *p == '.'){
+                // Only the first document is read
+                parsedSize_ = ((*p == '.') ? next : p) - text;
+                return Parsed;
+            }
+            if(checkLineEnd(p + 3, lineEnd) != Parsed){
+                return Unrecognized;
+            }
+            p = next;
+            continue;
+        }
+
+        auto result = parseLine(p, lineEnd);
+        if(result != Parsed){
+            return result;
+        }
+        isContentFound = true;
+        p = next;
+    }
+
+    parsedSize_ = size;
+    return Parsed;
+}
+
+BodyPositionParser::Result BodyPositionParser::parseLine(const char* begin, const char* end)
+{
+    auto p = begin;
+    while(p < end && (std::isalnum(static_cast<unsigned char>(*p)) || *p == '_')){
+        ++p;
+    }
+    auto keyEnd = p;
+    if(keyEnd == begin || p == end || *p != ':'){
+        return Unrecognized;
+    }
+    ++p;
+    if(p < end && !isSpace(*p)){
+        return Unrecognized;
+    }
+    p = skipSpaces(p, end);
+    if(p == end || *p == '#'){
+        return Unrecognized; // Block style value
+    }
+
+    Result result;
+    if(matchKey(begin, keyEnd, "translation")){
+        if(hasTranslation){
+            return Unrecognized;
+        }
+        result = parseVector3(p, end, translation);
+        hasTranslation = true;
+
+    } else if(matchKey(begin, keyEnd, "rotation")){
+        if(hasRotation){
+            return Unrecognized;
+        }
+        result = parseVector3(p, end, rotation);
+        hasRotation = true;
+
+    } else if(matchKey(begin, keyEnd, "flag_height")){
+        if(hasFlagHeight){
+            return Unrecognized;
+        }
+        result = parseDouble(p, end, flagHeight);
+        hasFlagHeight = true;
+
+    } else if(matchKey(begin, keyEnd, "flag_color")){
+        if(hasFlagColor){
+            return Unrecognized;
+        }
+        result = parseString(p, end, flagColor);
+        hasFlagColor = true;
+
+    } else {
+        return Unrecognized;
+    }
+
+    if(result != Parsed){
+        return result;
+    }
+    return checkLineEnd(p, end);
+}
+
+BodyPositionParser::Result BodyPositionParser::parseVector3
+(const char*& p, const char* end, cnoid::Vector3& out_v)
+{
+    if(*p != '['){
+        return Unrecognized;
+    }
+    ++p;
+    for(int i=0; i < 3; ++i){
+        p = skipSpaces(p, end);
+        if(p == end){
+            return Unrecognized; // Multi-line flow sequence
+        }
+        auto result = parseDouble(p, end, out_v[i]);
+        if(result != Parsed){
+            return result;
+        }
+        p = skipSpaces(p, end);
+        if(p == end){
+            return Unrecognized;
+        }
+        if(i < 2){
+            if(*p == ']'){
+                return setError(p, "Three elements are required");
+            } else if(*p != ','){
+                return setError(p, "',' is expected");
+            }
+            ++p;
+        }
+    }
+    if(*p == ','){
+        return setError(p, "Three elements are required");
+    } else if(*p != ']'){
+        return setError(p, "']' is expected");
+    }
+    ++p;
+    return Parsed;
+}
+
+const char* BodyPositionParser::readNumber(const char* p, const char* end, double& out_value)
+{
+    // The syntax is checked first because std::strtod and std::from_chars accept other forms
+    const char* q = p;
+    if(q < end && (*q == '+' || *q == '-')){
+        ++q;
+    }
+    const char* digitsBegin = q;
+    int numDigits = 0;
+    while(q < end && std::isdigit(static_cast<unsigned char>(*q))){
+        ++q;
+        ++numDigits;
+    }
+    if(q < end && *q == '.'){
+        ++q;
+        while(q < end && std::isdigit(static_cast<unsigned char>(*q))){
+            ++q;
+            ++numDigits;
+        }
+    }
+    if(numDigits == 0){
+        return nullptr;
+    }
+    if(q < end && (*q == 'e' || *q == 'E')){
+        const char* exponent = q + 1;
+        if(exponent < end && (*exponent == '+' || *exponent == '-')){
+            ++exponent;
+        }
+        if(exponent < end && std::isdigit(static_cast<unsigned char>(*exponent))){
+            q = exponent;
+            while(q < end && std::isdigit(static_cast<unsigned char>(*q))){
+                ++q;
+            }
+        }
+    }
+
+    double value;
+#ifdef __cpp_lib_to_chars
+    auto result = std::from_chars(digitsBegin, q, value);
+    if(result.ec != std::errc() || result.ptr != q){
+        return nullptr;
+    }
+#else
+    std::istringstream iss(std::string(digitsBegin, q));
+    iss.imbue(std::locale::classic());
+    if(!(iss >> value)){
+        return nullptr;
+    }
+#endif
+    if(!std::isfinite(value)){
+        return nullptr;
+    }
+    out_value = (*p == '-') ? -value : value;
+    return q;
+}
+
+BodyPositionParser::Result BodyPositionParser::parseDouble
+(const char*& p, const char* end, double& out_value)
+{
+    auto numberEnd = readNumber(p, end, out_value);
+    if(!numberEnd){
+        if(*p == '[' || *p == '{' || *p == '&' || *p == '*' || *p == '!'){
+            return Unrecognized;
+        }
+        return setError(p, "A finite decimal number is expected");
+    }
+    p = numberEnd;
+    return Parsed;
+}
+
+BodyPositionParser::Result BodyPositionParser::parseString
+(const char*& p, const char* end, std::string& out_value)
+{
+    const char* valueBegin;
+    const char* valueEnd;
+
+    if(*p == '"' || *p == '\''){
+        char quote = *p++;
+        valueBegin = p;
+        while(p < end && *p != quote){
+            if(*p == '\\' && quote == '"'){
+                return Unrecognized; // Escape sequence
+            }
+            ++p;
+        }
+        if(p == end){
+            return Unrecognized; // Multi-line scalar
+        }
+        valueEnd = p++;
+
+    } else {
+        if(std::strchr("[]{}&*!|>%@`,?:-", *p)){
+            return Unrecognized;
+        }
+        valueBegin = p;
+        valueEnd = p;
+        while(p < end && !(*p == '#' && isSpace(*(p - 1)))){
+            if(!isSpace(*p)){
+                valueEnd = p + 1;
+            }
+            ++p;
+        }
+        p = valueEnd;
+    }
+
+    out_value.assign(valueBegin, valueEnd);
+    return Parsed;
+}
+
+BodyPositionParser::Result BodyPositionParser::checkLineEnd(const char* p, const char* end)
+{
+    auto q = skipSpaces(p, end);
+    if(q == end || (*q == '#' && q != p)){
+        return Parsed;
+    }
+    return setError(q, "Unexpected characters");
+}
+
+BodyPositionParser::Result BodyPositionParser::setError(const char* p, const char* message)
+{
+    errorLine_ = currentLine;
+    errorColumn_ = static_cast<int>(p - currentLineBegin) + 1;
+    errorMessage_ = message;
+    return Error;
+}
+
+bool BodyPositionParser::loadWithYAMLReader(const std::string& filename)
+{
+    BodyPositionTrace::Span span("BodyPositionParser::loadWithYAMLReader");
+    try {
+        YAMLReader reader;
+        return readMapping(reader.loadDocument(filename)->toMapping());
+    }
+    catch(const ValueNode::Exception& ex){
+        clear();
+        errorMessage_ = ex.message();
+        return false;
+    }
+}
+
+bool BodyPositionParser::readMapping(const cnoid::Mapping* archive)
+{
+    clear();
+
+    try {
+        hasTranslation = read(*archive, "translation", translation);
+        hasRotation = read(*archive, "rotation", rotation);
+        hasFlagHeight = archive->read("flag_height", flagHeight);
+        hasFlagColor = archive->read("flag_color", flagColor);
+    }
+    catch(const ValueNode::Exception& ex){
+        errorMessage_ = ex.message();
+        return false;
+    }
+    return true;
+}
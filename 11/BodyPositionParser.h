@@ -0,0 +1,65 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_PARSER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_PARSER_H
+
+#include <cnoid/EigenTypes>
+#include <string>
+
+namespace cnoid { class Mapping; }
+
+/**
+   This class reads a body position file. The simple form output by BodyPositionWriter is
+   parsed directly without building a YAML document, and the other forms are read with YAMLReader.
+*/
+class BodyPositionParser
+{
+public:
+    BodyPositionParser();
+
+    bool load(const std::string& filename);
+
+    enum Result { Parsed, Unrecognized, Error };
+    Result parseFile(const std::string& filename);
+    // The text must be followed by a null character
+    Result parse(const char* text, size_t size);
+    // The next document of the text starts at this offset
+    size_t parsedSize() const { return parsedSize_; }
+    bool loadWithYAMLReader(const std::string& filename);
+    bool readMapping(const cnoid::Mapping* archive);
+
+    /**
+       A decimal number is read independently of the locale. The hexadecimal numbers and the
+       non-finite values are not accepted. Returns the end of the number or nullptr.
+    */
+    static const char* readNumber(const char* p, const char* end, double& out_value);
+
+    bool hasTranslation;
+    bool hasRotation;
+    bool hasFlagHeight;
+    bool hasFlagColor;
+    cnoid::Vector3 translation;
+    cnoid::Vector3 rotation;
+    double flagHeight;
+    std::string flagColor;
+
+    const std::string& errorMessage() const { return errorMessage_; }
+    int errorLine() const { return errorLine_; }
+    int errorColumn() const { return errorColumn_; }
+
+private:
+    void clear();
+    Result parseLine(const char* begin, const char* end);
+    Result parseVector3(const char*& p, const char* end, cnoid::Vector3& out_v);
+    Result parseDouble(const char*& p, const char* end, double& out_value);
+    Result parseString(const char*& p, const char* end, std::string& out_value);
+    Result checkLineEnd(const char* p, const char* end);
+    Result setError(const char* p, const char* message);
+
+    const char* currentLineBegin;
+    int currentLine;
+    size_t parsedSize_;
+    std::string errorMessage_;
+    int errorLine_;
+    int errorColumn_;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_PARSER_H
@@ -0,0 +1,475 @@
+#include "BodyPositionRecorder.h"
+#include "PoseStreamFormat.h"
+#include "PoseSequenceCodec.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/RootItem>
+#include <cnoid/BodyItem>
+#include <cnoid/BodyMotionItem>
+#include <cnoid/FolderItem>
+#include <cnoid/TimeBar>
+#include <cnoid/FileDialog>
+#include <cnoid/MessageView>
+#include <cnoid/stdx/filesystem>
+#include <QBoxLayout>
+#include <QLabel>
+#include <QSpinBox>
+#include <fmt/format.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <cstddef>
+#include <limits>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+
+namespace {
+
+const size_t RingBufferSize = 8 * 1024 * 1024; // bytes
+const size_t MinRingBufferFrames = 1024;
+const int WriterPollingInterval = 5; // msec
+
+struct Recording
+{
+    PoseStreamHeader header;
+    vector<string> bodyNames;
+    vector<double> values;
+    int frameLength;
+
+    double time(size_t frame) const { return values[frame * frameLength]; }
+    Isometry3 pose(size_t frame, int body) const
+    {
+        const double* v = &values[frame * frameLength + 1 + body * PoseStreamValuesPerPose];
+        Isometry3 T;
+        T.translation() << v[0], v[1], v[2];
+        T.linear() = Quaternion(v[6], v[3], v[4], v[5]).normalized().toRotationMatrix();
+        return T;
+    }
+};
+
+bool loadRecording(const string& filename, Recording& out_recording, ostream& os)
+{
+    BodyPositionTrace::Span span("BodyPositionRecorder::loadRecording");
+    ifstream ifs(filename, ios::binary);
+    if(!ifs){
+        os << format("\"{0}\" cannot be opened.", filename) << endl;
+        return false;
+    }
+    string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    string error;
+    auto& header = out_recording.header;
+    if(PoseSequenceCodec::isEncodedData(data.data(), data.size())){
+        if(!PoseSequenceCodec::decode(data.data(), data.size(), out_recording.bodyNames, out_recording.values, error)){
+            os << format("\"{0}\": {1}", filename, error) << endl;
+            return false;
+        }
+        out_recording.frameLength = 1 + PoseStreamValuesPerPose * out_recording.bodyNames.size();
+        header.numBodies = out_recording.bodyNames.size();
+        header.frameSize = getPoseStreamFrameSize(header.numBodies);
+        header.numFrames = out_recording.values.size() / out_recording.frameLength;
+        return true;
+    }
+    if(!readPoseStreamHeader(data.data(), data.size(), header, out_recording.bodyNames, error)){
+        os << format("\"{0}\": {1}", filename, error) << endl;
+        return false;
+    }
+    out_recording.frameLength = header.frameSize / sizeof(double);
+    out_recording.values.resize(header.numFrames * out_recording.frameLength);
+    std::memcpy(out_recording.values.data(), data.data() + header.dataOffset, header.numFrames * header.frameSize);
+    return true;
+}
+
+BodyItem* findBodyItem(const string& name)
+{
+    for(auto& bodyItem : RootItem::instance()->descendantItems<BodyItem>()){
+        if(bodyItem->name() == name){
+            return bodyItem;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+class BodyPositionRecorder::Impl
+{
+public:
+    vector<BodyItemPtr> bodyItems;
+    vector<string> bodyNames;
+    string filename;
+
+    // The ring buffer is written by the GUI thread and read by the writer thread
+    vector<double> ringBuffer;
+    size_t ringCapacity;
+    size_t frameLength;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> numDroppedFrames;
+    std::atomic<bool> isStopping;
+    double lastRecordedTime;
+
+    // Only accessed by the writer thread while recording
+    std::FILE* fp;
+    uint64_t numWrittenFrames;
+    bool hasWriteError;
+
+    thread writerThread;
+    ScopedConnection timeConnection;
+
+    Impl();
+    ~Impl();
+    bool start(const string& filename, ostream& os);
+    void stop(ostream& os);
+    bool onTimeChanged(double time);
+    void runWriter();
+    size_t writePendingFrames();
+};
+
+BodyPositionRecorder* BodyPositionRecorder::instance()
+{
+    static BodyPositionRecorder recorder;
+    return &recorder;
+}
+
+BodyPositionRecorder::BodyPositionRecorder()
+{
+    impl = new Impl;
+}
+
+BodyPositionRecorder::Impl::Impl()
+    : head(0), tail(0), numDroppedFrames(0), isStopping(false)
+{
+    ringCapacity = 0;
+    frameLength = 0;
+    fp = nullptr;
+    numWrittenFrames = 0;
+    hasWriteError = false;
+}
+
+BodyPositionRecorder::~BodyPositionRecorder()
+{
+    delete impl;
+}
+
+BodyPositionRecorder::Impl::~Impl()
+{
+    if(writerThread.joinable()){
+        stop(mvout());
+    }
+}
+
+bool BodyPositionRecorder::startRecording(const std::string& filename, std::ostream& os)
+{
+    return impl->start(filename, os);
+}
+
+bool BodyPositionRecorder::Impl::start(const string& filename, ostream& os)
+{
+    if(writerThread.joinable()){
+        os << "The poses are already being recorded." << endl;
+        return false;
+    }
+    bodyItems.clear();
+    bodyNames.clear();
+    for(auto& bodyItem : RootItem::instance()->selectedItems<BodyItem>()){
+        bodyItems.push_back(bodyItem);
+        bodyNames.push_back(bodyItem->name());
+    }
+    if(bodyItems.empty()){
+        os << "Select the body items whose poses are recorded." << endl;
+        return false;
+    }
+
+    fp = std::fopen(filename.c_str(), "wb");
+    if(!fp){
+        os << format("\"{0}\" cannot be created.", filename) << endl;
+        return false;
+    }
+    if(!writePoseStreamHeader(fp, bodyNames, 0)){
+        os << format("Failed to write \"{0}\".", filename) << endl;
+        std::fclose(fp);
+        fp = nullptr;
+        return false;
+    }
+    this->filename = filename;
+
+    frameLength = getPoseStreamFrameSize(bodyItems.size()) / sizeof(double);
+    ringCapacity = std::max(MinRingBufferFrames, RingBufferSize / (frameLength * sizeof(double)));
+    ringBuffer.assign(ringCapacity * frameLength, 0.0);
+    head = 0;
+    tail = 0;
+    numDroppedFrames = 0;
+    isStopping = false;
+    lastRecordedTime = -std::numeric_limits<double>::infinity();
+    numWrittenFrames = 0;
+    hasWriteError = false;
+
+    writerThread = thread([this](){ runWriter(); });
+
+    timeConnection =
+        TimeBar::instance()->sigTimeChanged().connect(
+            [this](double time){ return onTimeChanged(time); });
+
+    os << format("Recording the poses of {0} bodies to \"{1}\".", bodyItems.size(), filename) << endl;
+    return true;
+}
+
+void BodyPositionRecorder::stopRecording(std::ostream& os)
+{
+    impl->stop(os);
+}
+
+void BodyPositionRecorder::Impl::stop(ostream& os)
+{
+    if(!writerThread.joinable()){
+        return;
+    }
+    timeConnection.disconnect();
+    isStopping.store(true, std::memory_order_release);
+    writerThread.join();
+
+    if(hasWriteError){
+        os << format("Failed to write \"{0}\".", filename) << endl;
+    } else {
+        os << format("{0} frames have been recorded to \"{1}\".", numWrittenFrames, filename) << endl;
+    }
+    if(numDroppedFrames > 0){
+        os << format("{0} frames have been dropped because the writing did not keep up.",
+                     numDroppedFrames.load()) << endl;
+    }
+    bodyItems.clear();
+    ringBuffer = vector<double>();
+}
+
+bool BodyPositionRecorder::isRecording() const
+{
+    return impl->writerThread.joinable();
+}
+
+/**
+   The recording does not drive the playback, so false is returned. A time that is not later
+   than the last recorded time is skipped so that the frames are in the order of the time and
+   can be searched by the time.
+*/
+bool BodyPositionRecorder::Impl::onTimeChanged(double time)
+{
+    BodyPositionTrace::Span span("BodyPositionRecorder::onTimeChanged");
+    if(time <= lastRecordedTime){
+        return false;
+    }
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if(h - tail.load(std::memory_order_acquire) >= ringCapacity){
+        numDroppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    double* frame = &ringBuffer[(h % ringCapacity) * frameLength];
+    *frame++ = time;
+    for(auto& bodyItem : bodyItems){
+        auto& T = bodyItem->body()->rootLink()->position();
+        auto p = T.translation();
+        Quaternion q(T.linear());
+        *frame++ = p.x();
+        *frame++ = p.y();
+        *frame++ = p.z();
+        *frame++ = q.x();
+        *frame++ = q.y();
+        *frame++ = q.z();
+        *frame++ = q.w();
+    }
+    head.store(h + 1, std::memory_order_release);
+    lastRecordedTime = time;
+    return false;
+}
+
+void BodyPositionRecorder::Impl::runWriter()
+{
+    while(true){
+        // The flag is checked before the frames are taken so that no frame is left
+        bool stopping = isStopping.load(std::memory_order_acquire);
+        if(writePendingFrames() == 0){
+            if(stopping){
+                break;
+            }
+            this_thread::sleep_for(chrono::milliseconds(WriterPollingInterval));
+        }
+    }
+    if(!hasWriteError){
+        std::fflush(fp);
+        std::fseek(fp, offsetof(PoseStreamHeader, numFrames), SEEK_SET);
+        hasWriteError = (std::fwrite(&numWrittenFrames, sizeof(numWrittenFrames), 1, fp) != 1);
+    }
+    if(std::fclose(fp) != 0){
+        hasWriteError = true;
+    }
+    fp = nullptr;
+}
+
+size_t BodyPositionRecorder::Impl::writePendingFrames()
+{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    size_t numFrames = h - t;
+    while(t < h){
+        BodyPositionTrace::Span span("BodyPositionRecorder::writeFrames");
+        size_t index = t % ringCapacity;
+        size_t n = std::min<uint64_t>(h - t, ringCapacity - index);
+        if(!hasWriteError){
+            if(std::fwrite(&ringBuffer[index * frameLength], frameLength * sizeof(double), n, fp) == n){
+                numWrittenFrames += n;
+            } else {
+                hasWriteError = true;
+            }
+        }
+        t += n;
+        tail.store(t, std::memory_order_release);
+    }
+    return numFrames;
+}
+
+bool BodyPositionRecorder::startRecordingWithDialog()
+{
+    FileDialog dialog;
+    dialog.setWindowTitle("Record Poses");
+    dialog.setFileMode(QFileDialog::AnyFile);
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setViewMode(QFileDialog::List);
+    dialog.setLabelText(QFileDialog::Accept, "Record");
+    dialog.setNameFilters({ "Pose stream files (*.poses)", "Any files (*)" });
+    dialog.updatePresetDirectories();
+    if(dialog.exec() != QDialog::Accepted || dialog.selectedFiles().isEmpty()){
+        return false;
+    }
+    string filename = dialog.selectedFiles().front().toStdString();
+    if(stdx::filesystem::path(filename).extension().empty()){
+        filename += ".poses";
+    }
+    return instance()->startRecording(filename, mvout());
+}
+
+bool BodyPositionRecorder::createBodyPositionItems(const std::string& filename, int frameStep, std::ostream& os)
+{
+    Recording recording;
+    if(!loadRecording(filename, recording, os)){
+        return false;
+    }
+    frameStep = std::max(1, frameStep);
+    string name = stdx::filesystem::path(filename).stem().string();
+    int numConverted = 0;
+
+    BodyPositionItem::beginItemsInProjectChangeBatch();
+    for(size_t i=0; i < recording.bodyNames.size(); ++i){
+        auto bodyItem = findBodyItem(recording.bodyNames[i]);
+        if(!bodyItem){
+            os << format("Body \"{0}\" is not found in the project.", recording.bodyNames[i]) << endl;
+            continue;
+        }
+        FolderItemPtr folderItem = new FolderItem;
+        folderItem->setName(name);
+        for(uint64_t frame = 0; frame < recording.header.numFrames; frame += frameStep){
+            auto item = new BodyPositionItem;
+            item->setName(format("{0:.3f}", recording.time(frame)));
+            item->setPosition(recording.pose(frame, i));
+            folderItem->addChildItem(item);
+        }
+        bodyItem->addChildItem(folderItem);
+        ++numConverted;
+    }
+    BodyPositionItem::endItemsInProjectChangeBatch();
+
+    return numConverted > 0;
+}
+
+bool BodyPositionRecorder::createBodyMotionItems(const std::string& filename, double frameRate, std::ostream& os)
+{
+    Recording recording;
+    if(!loadRecording(filename, recording, os)){
+        return false;
+    }
+    uint64_t numFrames = recording.header.numFrames;
+    if(numFrames == 0 || frameRate <= 0.0){
+        os << format("\"{0}\" does not have any frame.", filename) << endl;
+        return false;
+    }
+    string name = stdx::filesystem::path(filename).stem().string();
+    double startTime = recording.time(0);
+    int numMotionFrames = static_cast<int>((recording.time(numFrames - 1) - startTime) * frameRate) + 1;
+    int numConverted = 0;
+
+    for(size_t i=0; i < recording.bodyNames.size(); ++i){
+        auto bodyItem = findBodyItem(recording.bodyNames[i]);
+        if(!bodyItem){
+            os << format("Body \"{0}\" is not found in the project.", recording.bodyNames[i]) << endl;
+            continue;
+        }
+        BodyMotionItemPtr motionItem = new BodyMotionItem;
+        motionItem->setName(name);
+        auto motion = motionItem->motion();
+        motion->setFrameRate(frameRate);
+        motion->setDimension(numMotionFrames, 0, 1);
+        auto seq = motion->positionSeq();
+
+        // The recorded frames are interpolated because the time changes are not regular
+        uint64_t frame = 0;
+        for(int k=0; k < numMotionFrames; ++k){
+            double time = startTime + k / frameRate;
+            while(frame + 1 < numFrames && recording.time(frame + 1) <= time){
+                ++frame;
+            }
+            Isometry3 T = recording.pose(frame, i);
+            if(frame + 1 < numFrames){
+                double t0 = recording.time(frame);
+                double t1 = recording.time(frame + 1);
+                if(t1 > t0){
+                    double u = (time - t0) / (t1 - t0);
+                    Isometry3 T1 = recording.pose(frame + 1, i);
+                    T.translation() = (1.0 - u) * T.translation() + u * T1.translation();
+                    T.linear() = Quaternion(T.linear()).slerp(u, Quaternion(T1.linear())).toRotationMatrix();
+                }
+            }
+            seq->frame(k).linkPosition(0).set(T);
+        }
+        bodyItem->addChildItem(motionItem);
+        ++numConverted;
+    }
+
+    return numConverted > 0;
+}
+
+void BodyPositionRecorder::convertRecordingWithDialog(bool toBodyMotion)
+{
+    FileDialog dialog;
+    dialog.setWindowTitle(toBodyMotion ? "Convert Pose Recording to Body Motions" :
+                          "Convert Pose Recording to Body Positions");
+    dialog.setFileMode(QFileDialog::ExistingFile);
+    dialog.setViewMode(QFileDialog::List);
+    dialog.setLabelText(QFileDialog::Accept, "Convert");
+    dialog.setNameFilters({ "Pose stream files (*.poses *.cposes)", "Any files (*)" });
+    dialog.updatePresetDirectories();
+
+    QSpinBox* frameStepSpin = nullptr;
+    if(!toBodyMotion){
+        auto panel = new QWidget;
+        auto hbox = new QHBoxLayout;
+        panel->setLayout(hbox);
+        hbox->addWidget(new QLabel("Frame step"));
+        frameStepSpin = new QSpinBox;
+        frameStepSpin->setRange(1, 1000000);
+        frameStepSpin->setValue(100);
+        hbox->addWidget(frameStepSpin);
+        hbox->addStretch();
+        dialog.insertOptionPanel(panel);
+    }
+
+    if(dialog.exec() != QDialog::Accepted || dialog.selectedFiles().isEmpty()){
+        return;
+    }
+    string filename = dialog.selectedFiles().front().toStdString();
+    if(toBodyMotion){
+        createBodyMotionItems(filename, TimeBar::instance()->frameRate(), mvout());
+    } else {
+        createBodyPositionItems(filename, frameStepSpin->value(), mvout());
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_RECORDER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_RECORDER_H
+
+#include "BodyPositionItem.h"
+#include <string>
+#include <ostream>
+
+/**
+   This class records the root link poses of the selected body items on every time change of
+   the time bar to a pose stream file. See PoseStreamFormat.h for the format.
+
+   The poses are put into a ring buffer allocated when the recording is started, and a writer
+   thread takes them from the buffer and writes them to the file. The GUI thread neither
+   allocates memory nor accesses the file while recording. The frames that do not fit in the
+   buffer are dropped and counted.
+*/
+class BodyPositionRecorder
+{
+public:
+    static BodyPositionRecorder* instance();
+
+    bool startRecording(const std::string& filename, std::ostream& os);
+    void stopRecording(std::ostream& os);
+    bool isRecording() const;
+
+    // Returns false if the recording is not started
+    static bool startRecordingWithDialog();
+
+    /**
+       The recorded poses are converted for the body items in the project whose names match
+       the names in the recording. The body position items are created for every frameStep
+       frames, and the body motion items are resampled at the frame rate. The file may be
+       encoded by PoseSequenceCodec.
+    */
+    static bool createBodyPositionItems(const std::string& filename, int frameStep, std::ostream& os);
+    static bool createBodyMotionItems(const std::string& filename, double frameRate, std::ostream& os);
+    static void convertRecordingWithDialog(bool toBodyMotion);
+
+private:
+    BodyPositionRecorder();
+    ~BodyPositionRecorder();
+
+    class Impl;
+    Impl* impl;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_RECORDER_H
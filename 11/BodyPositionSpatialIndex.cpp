@@ -0,0 +1,477 @@
+#include "BodyPositionSpatialIndex.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/RootItem>
+#include <cnoid/BodyItem>
+#include <cnoid/MessageView>
+#include <fmt/format.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+
+namespace {
+
+const double DefaultCellSize = 0.5;
+const double DefaultOrientationWeight = 0.2;
+
+// The cell indices are clamped so that the differences between them do not overflow
+const double MaxCellIndex = 1 << 29;
+
+struct CellKey
+{
+    int x, y, z;
+    bool operator==(const CellKey& key) const { return x == key.x && y == key.y && z == key.z; }
+};
+
+struct CellKeyHash
+{
+    size_t operator()(const CellKey& key) const
+    {
+        return (size_t(key.x) * 73856093u) ^ (size_t(key.y) * 19349663u) ^ (size_t(key.z) * 83492791u);
+    }
+};
+
+int chebyshevDistance(const CellKey& a, const CellKey& b)
+{
+    return std::max({ std::abs(a.x - b.x), std::abs(a.y - b.y), std::abs(a.z - b.z) });
+}
+
+double numCellsInRing(int ring)
+{
+    if(ring == 0){
+        return 1.0;
+    }
+    double outer = 2.0 * ring + 1.0;
+    double inner = 2.0 * ring - 1.0;
+    return outer * outer * outer - inner * inner * inner;
+}
+
+bool isCloser(const BodyPositionSpatialIndex::Neighbor& a, const BodyPositionSpatialIndex::Neighbor& b)
+{
+    return a.distance < b.distance;
+}
+
+}
+
+class BodyPositionSpatialIndex::Impl
+{
+public:
+    struct Entry
+    {
+        Vector3 translation;
+        Quaternion rotation;
+        CellKey cell;
+        // -1 if the translation is not finite and the item is not in any cell
+        int cellIndex;
+        ScopedConnection connection;
+    };
+    unordered_map<BodyPositionItem*, unique_ptr<Entry>> entries;
+    unordered_map<CellKey, vector<BodyPositionItem*>, CellKeyHash> cells;
+
+    // The items whose files are pending are indexed when they are loaded or searched
+    unordered_set<BodyPositionItem*> pendingItems;
+
+    // The bounds are only extended until the cells are rebuilt
+    CellKey minCell;
+    CellKey maxCell;
+
+    double cellSize;
+    double orientationWeight;
+    ScopedConnection projectConnection;
+    ScopedConnection pendingFileLoadConnection;
+
+    Impl();
+    CellKey getCell(const Vector3& p) const;
+    void addItem(BodyPositionItem* item);
+    void addPendingItems();
+    void onPendingFileLoaded(BodyPositionItem* item);
+    void removeItem(BodyPositionItem* item);
+    void insertToCell(BodyPositionItem* item, Entry* entry);
+    void eraseFromCell(Entry* entry);
+    void onItemUpdated(BodyPositionItem* item);
+    void rebuildCells();
+    double distance(const Isometry3& T, const Quaternion& q, const Entry* entry) const;
+    int getMaxRing(const CellKey& center) const;
+    template<class Visit> void forEachCellInRing(const CellKey& center, int ring, Visit visit) const;
+    template<class Visit> void visitItems(
+        const vector<BodyPositionItem*>& items, BodyItem* owner, Visit& visit) const;
+};
+
+BodyPositionSpatialIndex* BodyPositionSpatialIndex::instance()
+{
+    static BodyPositionSpatialIndex index;
+    return &index;
+}
+
+BodyPositionSpatialIndex::BodyPositionSpatialIndex()
+{
+    impl = new Impl;
+}
+
+BodyPositionSpatialIndex::Impl::Impl()
+{
+    cellSize = DefaultCellSize;
+    orientationWeight = DefaultOrientationWeight;
+    minCell = { 0, 0, 0 };
+    maxCell = { 0, 0, 0 };
+
+    BodyPositionTrace::Span span("BodyPositionSpatialIndex::build");
+    for(auto& item : BodyPositionItem::registeredItems()){
+        addItem(item);
+    }
+    projectConnection =
+        BodyPositionItem::sigItemsInProjectChanged().connect(
+            [this](const ItemList<BodyPositionItem>& addedItems,
+                   const ItemList<BodyPositionItem>& removedItems){
+                for(auto& item : removedItems){
+                    removeItem(item);
+                }
+                for(auto& item : addedItems){
+                    addItem(item);
+                }
+            });
+    pendingFileLoadConnection =
+        BodyPositionItem::sigPendingFileLoaded().connect(
+            [this](BodyPositionItem* item){ onPendingFileLoaded(item); });
+}
+
+BodyPositionSpatialIndex::~BodyPositionSpatialIndex()
+{
+    delete impl;
+}
+
+void BodyPositionSpatialIndex::setCellSize(double size)
+{
+    if(size > 0.0 && size != impl->cellSize){
+        impl->cellSize = size;
+        impl->rebuildCells();
+    }
+}
+
+double BodyPositionSpatialIndex::cellSize() const
+{
+    return impl->cellSize;
+}
+
+void BodyPositionSpatialIndex::setOrientationWeight(double weight)
+{
+    if(weight >= 0.0){
+        impl->orientationWeight = weight;
+    }
+}
+
+double BodyPositionSpatialIndex::orientationWeight() const
+{
+    return impl->orientationWeight;
+}
+
+// The translation must be finite
+CellKey BodyPositionSpatialIndex::Impl::getCell(const Vector3& p) const
+{
+    Vector3 index = (p / cellSize).array().floor().max(-MaxCellIndex).min(MaxCellIndex);
+    return { static_cast<int>(index.x()), static_cast<int>(index.y()), static_cast<int>(index.z()) };
+}
+
+// The file of a pending item is not loaded here
+void BodyPositionSpatialIndex::Impl::addItem(BodyPositionItem* item)
+{
+    if(item->isLoadPending()){
+        pendingItems.insert(item);
+        return;
+    }
+    auto& entry = entries[item];
+    if(entry){
+        return;
+    }
+    entry.reset(new Entry);
+    entry->translation = item->translation();
+    entry->rotation = item->rotation();
+    insertToCell(item, entry.get());
+    entry->connection =
+        item->sigUpdated().connect(
+            [this, item](){ onItemUpdated(item); });
+}
+
+// The pending files are loaded because the positions of all the items are needed by a search
+void BodyPositionSpatialIndex::Impl::addPendingItems()
+{
+    if(!pendingItems.empty()){
+        vector<BodyPositionItem*> items(pendingItems.begin(), pendingItems.end());
+        pendingItems.clear();
+        for(auto& item : items){
+            item->ensureLoaded();
+            addItem(item);
+        }
+    }
+}
+
+void BodyPositionSpatialIndex::Impl::onPendingFileLoaded(BodyPositionItem* item)
+{
+    if(pendingItems.erase(item)){
+        addItem(item);
+    }
+}
+
+void BodyPositionSpatialIndex::Impl::removeItem(BodyPositionItem* item)
+{
+    pendingItems.erase(item);
+    auto p = entries.find(item);
+    if(p != entries.end()){
+        eraseFromCell(p->second.get());
+        entries.erase(p);
+    }
+}
+
+void BodyPositionSpatialIndex::Impl::insertToCell(BodyPositionItem* item, Entry* entry)
+{
+    if(!entry->translation.allFinite()){
+        entry->cellIndex = -1;
+        return;
+    }
+    auto cell = getCell(entry->translation);
+    if(cells.empty()){
+        minCell = cell;
+        maxCell = cell;
+    } else {
+        minCell = { std::min(minCell.x, cell.x), std::min(minCell.y, cell.y), std::min(minCell.z, cell.z) };
+        maxCell = { std::max(maxCell.x, cell.x), std::max(maxCell.y, cell.y), std::max(maxCell.z, cell.z) };
+    }
+    auto& items = cells[cell];
+    entry->cell = cell;
+    entry->cellIndex = items.size();
+    items.push_back(item);
+}
+
+// The last item of the cell is moved to the position of the removed item
+void BodyPositionSpatialIndex::Impl::eraseFromCell(Entry* entry)
+{
+    if(entry->cellIndex < 0){
+        return;
+    }
+    auto p = cells.find(entry->cell);
+    auto& items = p->second;
+    auto movedItem = items.back();
+    items[entry->cellIndex] = movedItem;
+    entries[movedItem]->cellIndex = entry->cellIndex;
+    items.pop_back();
+    if(items.empty()){
+        cells.erase(p);
+    }
+}
+
+void BodyPositionSpatialIndex::Impl::onItemUpdated(BodyPositionItem* item)
+{
+    auto entry = entries[item].get();
+    entry->translation = item->translation();
+    entry->rotation = item->rotation();
+    bool isFinite = entry->translation.allFinite();
+    if(entry->cellIndex < 0 || !isFinite || !(getCell(entry->translation) == entry->cell)){
+        eraseFromCell(entry);
+        insertToCell(item, entry);
+    }
+}
+
+void BodyPositionSpatialIndex::Impl::rebuildCells()
+{
+    cells.clear();
+    for(auto& kv : entries){
+        insertToCell(kv.first, kv.second.get());
+    }
+}
+
+double BodyPositionSpatialIndex::distance(const cnoid::Isometry3& T, BodyPositionItem* item) const
+{
+    Quaternion q(T.linear());
+    auto p = impl->entries.find(item);
+    if(p != impl->entries.end()){
+        return impl->distance(T, q, p->second.get());
+    }
+    Impl::Entry entry;
+    entry.translation = item->translation();
+    entry.rotation = item->rotation();
+    return impl->distance(T, q, &entry);
+}
+
+double BodyPositionSpatialIndex::Impl::distance(const Isometry3& T, const Quaternion& q, const Entry* entry) const
+{
+    double d = (T.translation() - entry->translation).norm();
+    if(orientationWeight > 0.0){
+        double c = std::min(1.0, std::abs(q.dot(entry->rotation)));
+        d += orientationWeight * 2.0 * std::acos(c);
+    }
+    return d;
+}
+
+// Returns the ring beyond which there is no cell, or -1 if there is no cell
+int BodyPositionSpatialIndex::Impl::getMaxRing(const CellKey& center) const
+{
+    if(cells.empty()){
+        return -1;
+    }
+    return std::max({ std::abs(center.x - minCell.x), std::abs(maxCell.x - center.x),
+                      std::abs(center.y - minCell.y), std::abs(maxCell.y - center.y),
+                      std::abs(center.z - minCell.z), std::abs(maxCell.z - center.z) });
+}
+
+template<class Visit>
+void BodyPositionSpatialIndex::Impl::forEachCellInRing(const CellKey& center, int ring, Visit visit) const
+{
+    for(int x = -ring; x <= ring; ++x){
+        for(int y = -ring; y <= ring; ++y){
+            bool isOnSide = (std::abs(x) == ring || std::abs(y) == ring);
+            int zStep = (isOnSide || ring == 0) ? 1 : 2 * ring;
+            for(int z = -ring; z <= ring; z += zStep){
+                auto p = cells.find({ center.x + x, center.y + y, center.z + z });
+                if(p != cells.end()){
+                    visit(p->second);
+                }
+            }
+        }
+    }
+}
+
+// The items owned by the owner are visited if the owner is given
+template<class Visit>
+void BodyPositionSpatialIndex::Impl::visitItems
+(const vector<BodyPositionItem*>& items, BodyItem* owner, Visit& visit) const
+{
+    for(auto& item : items){
+        if(!owner || item->ownerBodyItem() == owner){
+            visit(item, entries.find(item)->second.get());
+        }
+    }
+}
+
+vector<BodyPositionSpatialIndex::Neighbor> BodyPositionSpatialIndex::findNearest
+(const cnoid::Isometry3& T, int k, cnoid::BodyItem* owner) const
+{
+    BodyPositionTrace::Span span("BodyPositionSpatialIndex::findNearest");
+    vector<Neighbor> heap;
+    if(k <= 0){
+        return heap;
+    }
+    if(!T.translation().allFinite()){
+        return heap;
+    }
+    impl->addPendingItems();
+    heap.reserve(k);
+    Quaternion q(T.linear());
+    auto center = impl->getCell(T.translation());
+    int maxRing = impl->getMaxRing(center);
+    size_t numCells = impl->cells.size();
+
+    auto visit =
+        [&](BodyPositionItem* item, const Impl::Entry* entry){
+            double d = impl->distance(T, q, entry);
+            if(static_cast<int>(heap.size()) < k){
+                heap.push_back({ item, d });
+                push_heap(heap.begin(), heap.end(), isCloser);
+            } else if(d < heap.front().distance){
+                pop_heap(heap.begin(), heap.end(), isCloser);
+                heap.back() = { item, d };
+                push_heap(heap.begin(), heap.end(), isCloser);
+            }
+        };
+
+    for(int ring = 0; ring <= maxRing; ++ring){
+        // The translation distance to the cells in the ring is at least (ring - 1) cells
+        if(static_cast<int>(heap.size()) == k && heap.front().distance <= (ring - 1) * impl->cellSize){
+            break;
+        }
+        if(numCellsInRing(ring) > numCells){
+            // The remaining occupied cells are visited directly when the grid is sparse
+            for(auto& kv : impl->cells){
+                if(chebyshevDistance(kv.first, center) >= ring){
+                    impl->visitItems(kv.second, owner, visit);
+                }
+            }
+            break;
+        }
+        impl->forEachCellInRing(
+            center, ring, [&](const vector<BodyPositionItem*>& items){ impl->visitItems(items, owner, visit); });
+    }
+
+    sort_heap(heap.begin(), heap.end(), isCloser);
+    return heap;
+}
+
+vector<BodyPositionSpatialIndex::Neighbor> BodyPositionSpatialIndex::findWithinRadius
+(const cnoid::Isometry3& T, double radius, cnoid::BodyItem* owner) const
+{
+    BodyPositionTrace::Span span("BodyPositionSpatialIndex::findWithinRadius");
+    vector<Neighbor> neighbors;
+    if(!(radius >= 0.0) || !T.translation().allFinite()){
+        return neighbors;
+    }
+    impl->addPendingItems();
+    Quaternion q(T.linear());
+    auto center = impl->getCell(T.translation());
+    int maxRing = impl->getMaxRing(center);
+    if(radius / impl->cellSize + 1.0 < maxRing){
+        maxRing = static_cast<int>(radius / impl->cellSize) + 1;
+    }
+
+    auto visit =
+        [&](BodyPositionItem* item, const Impl::Entry* entry){
+            double d = impl->distance(T, q, entry);
+            if(d <= radius){
+                neighbors.push_back({ item, d });
+            }
+        };
+
+    double cubeSize = 2.0 * maxRing + 1.0;
+    if(cubeSize * cubeSize * cubeSize > impl->cells.size()){
+        for(auto& kv : impl->cells){
+            if(chebyshevDistance(kv.first, center) <= maxRing){
+                impl->visitItems(kv.second, owner, visit);
+            }
+        }
+    } else {
+        for(int ring = 0; ring <= maxRing; ++ring){
+            impl->forEachCellInRing(
+                center, ring, [&](const vector<BodyPositionItem*>& items){ impl->visitItems(items, owner, visit); });
+        }
+    }
+
+    std::sort(neighbors.begin(), neighbors.end(), isCloser);
+    return neighbors;
+}
+
+/**
+   The target bodies are the selected body items and the owners of the selected position items.
+   Only the position items owned by each body are searched.
+*/
+void BodyPositionSpatialIndex::restoreNearestBodyPositions()
+{
+    BodyPositionTrace::Span span("BodyPositionSpatialIndex::restoreNearestBodyPositions");
+    vector<BodyItem*> bodyItems;
+    for(auto& bodyItem : RootItem::instance()->selectedItems<BodyItem>()){
+        bodyItems.push_back(bodyItem);
+    }
+    for(auto item = BodyPositionItem::firstSelectedRegisteredItem(); item;
+        item = item->nextSelectedRegisteredItem()){
+        auto owner = item->ownerBodyItem();
+        if(owner && find(bodyItems.begin(), bodyItems.end(), owner) == bodyItems.end()){
+            bodyItems.push_back(owner);
+        }
+    }
+    if(bodyItems.empty()){
+        mvout() << "Select the body items whose nearest positions are restored." << endl;
+        return;
+    }
+
+    auto index = instance();
+    for(auto& bodyItem : bodyItems){
+        auto neighbors = index->findNearest(bodyItem->body()->rootLink()->position(), 1, bodyItem);
+        if(neighbors.empty()){
+            mvout() << format("{0} does not have any body position item.", bodyItem->name()) << endl;
+        } else {
+            neighbors.front().item->restoreBodyPosition();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_SPATIAL_INDEX_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_SPATIAL_INDEX_H
+
+#include "BodyPositionItem.h"
+#include <vector>
+
+/**
+   This class indexes the positions of the body position items in the project with a uniform
+   grid over the translations. The index is updated incrementally when the items are added,
+   removed or updated, and is created when it is first used.
+
+   The distance between two poses is the distance between the translations plus the angle
+   between the rotations multiplied by the orientation weight. The grid is searched with the
+   translation distance, which is a lower bound of the pose distance, and the candidates are
+   refined with the pose distance.
+*/
+class BodyPositionSpatialIndex
+{
+public:
+    static BodyPositionSpatialIndex* instance();
+
+    void setCellSize(double size);
+    double cellSize() const;
+    // The weight is the length in meters that corresponds to the rotation of one radian
+    void setOrientationWeight(double weight);
+    double orientationWeight() const;
+    double distance(const cnoid::Isometry3& T, BodyPositionItem* item) const;
+
+    struct Neighbor
+    {
+        BodyPositionItem* item;
+        double distance;
+    };
+
+    // The neighbors are sorted in the ascending order of the distance
+    std::vector<Neighbor> findNearest(
+        const cnoid::Isometry3& T, int k, cnoid::BodyItem* owner = nullptr) const;
+    std::vector<Neighbor> findWithinRadius(
+        const cnoid::Isometry3& T, double radius, cnoid::BodyItem* owner = nullptr) const;
+
+    // The position item nearest to the current position of each target body is restored
+    static void restoreNearestBodyPositions();
+
+private:
+    BodyPositionSpatialIndex();
+    ~BodyPositionSpatialIndex();
+
+    class Impl;
+    Impl* impl;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_SPATIAL_INDEX_H
@@ -0,0 +1,137 @@
+#include "BodyPositionTrace.h"
+#include <fmt/format.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+using namespace fmt;
+
+namespace {
+
+const size_t BufferCapacity = 65536;
+
+struct Event
+{
+    const char* name;
+    int64_t beginTime;
+    int64_t endTime;
+};
+
+/**
+   A buffer is only written by its thread. The number of the events is published with the
+   release order so that the events below it can be read by the thread that writes the file.
+   A buffer whose generation is older than the current one is regarded as empty, and the
+   writing thread resets it when it records the next event.
+*/
+struct ThreadBuffer
+{
+    int threadId;
+    std::atomic<size_t> numEvents;
+    std::atomic<int> generation;
+    Event events[BufferCapacity];
+
+    ThreadBuffer(int threadId, int generation)
+        : threadId(threadId), numEvents(0), generation(generation) { }
+};
+
+std::mutex bufferListMutex;
+vector<ThreadBuffer*> bufferList;
+std::atomic<int> currentGeneration(0);
+std::atomic<size_t> numDroppedEvents(0);
+const auto baseTime = chrono::steady_clock::now();
+
+// The buffers of the finished threads are kept so that their spans can be written
+ThreadBuffer* getThreadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if(!buffer){
+        std::lock_guard<std::mutex> lock(bufferListMutex);
+        buffer = new ThreadBuffer(bufferList.size() + 1, currentGeneration.load());
+        bufferList.push_back(buffer);
+    }
+    return buffer;
+}
+
+void writeEscapedString(std::FILE* fp, const char* s)
+{
+    for(; *s; ++s){
+        if(*s == '"' || *s == '\\'){
+            std::fputc('\\', fp);
+        }
+        std::fputc(*s, fp);
+    }
+}
+
+}
+
+std::atomic<bool> BodyPositionTrace::isEnabled_(false);
+
+void BodyPositionTrace::setEnabled(bool on)
+{
+    if(on && !isEnabled()){
+        // The spans recorded before are discarded
+        ++currentGeneration;
+        numDroppedEvents = 0;
+    }
+    isEnabled_ = on;
+}
+
+int64_t BodyPositionTrace::now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - baseTime).count();
+}
+
+void BodyPositionTrace::record(const char* name, int64_t beginTime, int64_t endTime)
+{
+    auto buffer = getThreadBuffer();
+    int generation = currentGeneration.load(std::memory_order_relaxed);
+    if(buffer->generation.load(std::memory_order_relaxed) != generation){
+        buffer->numEvents.store(0, std::memory_order_relaxed);
+        buffer->generation.store(generation, std::memory_order_release);
+    }
+    size_t n = buffer->numEvents.load(std::memory_order_relaxed);
+    if(n >= BufferCapacity){
+        numDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[n] = { name, beginTime, endTime };
+    buffer->numEvents.store(n + 1, std::memory_order_release);
+}
+
+bool BodyPositionTrace::writeChromeTraceFile(const std::string& filename)
+{
+    auto fp = std::fopen(filename.c_str(), "w");
+    if(!fp){
+        return false;
+    }
+    vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(bufferListMutex);
+        buffers = bufferList;
+    }
+    int generation = currentGeneration.load();
+
+    print(fp, "{{\"traceEvents\":[\n");
+    bool isFirst = true;
+    for(auto& buffer : buffers){
+        if(buffer->generation.load(std::memory_order_acquire) != generation){
+            continue;
+        }
+        size_t n = buffer->numEvents.load(std::memory_order_acquire);
+        for(size_t i=0; i < n; ++i){
+            auto& event = buffer->events[i];
+            print(fp, "{0}{{\"name\":\"", isFirst ? "" : ",\n");
+            writeEscapedString(fp, event.name);
+            print(fp, "\",\"ph\":\"X\",\"pid\":1,\"tid\":{0},\"ts\":{1:.3f},\"dur\":{2:.3f}}}",
+                  buffer->threadId, event.beginTime / 1000.0, (event.endTime - event.beginTime) / 1000.0);
+            isFirst = false;
+        }
+    }
+    print(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{{\"droppedEvents\":{0}}}}}\n",
+          numDroppedEvents.load());
+
+    bool failed = std::ferror(fp);
+    return (std::fclose(fp) == 0) && !failed;
+}
@@ -0,0 +1,51 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_TRACE_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+   This class records the spans of the plugin operations and writes them in the Chrome trace
+   event format. Each thread records its spans to its own buffer without locking, and a span
+   only checks a flag when the tracing is disabled.
+*/
+class BodyPositionTrace
+{
+public:
+    static void setEnabled(bool on);
+    static bool isEnabled() { return isEnabled_.load(std::memory_order_relaxed); }
+    static bool writeChromeTraceFile(const std::string& filename);
+
+    // The name must be a string literal because only the pointer is recorded
+    class Span
+    {
+    public:
+        Span(const char* name)
+            : name(isEnabled() ? name : nullptr)
+        {
+            if(this->name){
+                beginTime = now();
+            }
+        }
+        ~Span()
+        {
+            if(name){
+                record(name, beginTime, now());
+            }
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name;
+        int64_t beginTime;
+    };
+
+private:
+    static std::atomic<bool> isEnabled_;
+    static int64_t now();
+    static void record(const char* name, int64_t beginTime, int64_t endTime);
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_TRACE_H
@@ -0,0 +1,112 @@
+#include "BodyPositionWriter.h"
+#include <fmt/format.h>
+#include <cstring>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+const size_t BufferSize = 64 * 1024;
+
+}
+
+BodyPositionWriter::BodyPositionWriter()
+{
+    file = nullptr;
+    numDocuments_ = 0;
+    hasError = false;
+    buf.reserve(BufferSize);
+}
+
+BodyPositionWriter::~BodyPositionWriter()
+{
+    closeFile();
+}
+
+bool BodyPositionWriter::openFile(const std::string& filename)
+{
+    closeFile();
+    file = std::fopen(filename.c_str(), "wb");
+    numDocuments_ = 0;
+    hasError = false;
+    return file != nullptr;
+}
+
+bool BodyPositionWriter::closeFile()
+{
+    bool result = true;
+    if(file){
+        result = flush();
+        if(std::fclose(file) != 0){
+            result = false;
+        }
+        file = nullptr;
+    }
+    return result;
+}
+
+bool BodyPositionWriter::flush()
+{
+    if(file && !buf.empty()){
+        if(std::fwrite(buf.data(), 1, buf.size(), file) != buf.size()){
+            hasError = true;
+        }
+        buf.clear();
+    }
+    return !hasError;
+}
+
+void BodyPositionWriter::takeText(std::vector<char>& out_text)
+{
+    out_text.swap(buf);
+    buf.clear();
+    numDocuments_ = 0;
+}
+
+void BodyPositionWriter::putBodyPosition
+(const Vector3& translation, const Vector3& rotation, double flagHeight, const std::string& flagColor)
+{
+    if(numDocuments_ > 0){
+        putString("---\n");
+    }
+    putVector3("translation: [ ", translation);
+    putVector3("rotation: [ ", rotation);
+    putString("flag_height: ");
+    putDouble(flagHeight);
+    putString("\nflag_color: ");
+    putString(flagColor.data(), flagColor.size());
+    putString("\n");
+    ++numDocuments_;
+
+    if(buf.size() >= BufferSize){
+        flush();
+    }
+}
+
+void BodyPositionWriter::putVector3(const char* key, const Vector3& v)
+{
+    putString(key);
+    putDouble(v[0]);
+    putString(", ");
+    putDouble(v[1]);
+    putString(", ");
+    putDouble(v[2]);
+    putString(" ]\n");
+}
+
+// The format is the same as the default double format of the YAML nodes.
+void BodyPositionWriter::putDouble(double value)
+{
+    fmt::format_to(std::back_inserter(buf), "{:.7g}", value);
+}
+
+void BodyPositionWriter::putString(const char* str)
+{
+    putString(str, std::strlen(str));
+}
+
+void BodyPositionWriter::putString(const char* str, size_t size)
+{
+    buf.insert(buf.end(), str, str + size);
+}
@@ -0,0 +1,42 @@
+#ifndef DEVGUIDE_PLUGIN_BODY_POSITION_WRITER_H
+#define DEVGUIDE_PLUGIN_BODY_POSITION_WRITER_H
+
+#include <cnoid/EigenTypes>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+/**
+   This class outputs the same text as YAMLWriter does for a body position mapping
+   without building the mapping. Each position is put as a separate YAML document.
+*/
+class BodyPositionWriter
+{
+public:
+    BodyPositionWriter();
+    ~BodyPositionWriter();
+    bool openFile(const std::string& filename);
+    bool closeFile();
+    bool isOpen() const { return file != nullptr; }
+    void putBodyPosition(
+        const cnoid::Vector3& translation, const cnoid::Vector3& rotation,
+        double flagHeight, const std::string& flagColor);
+    int numDocuments() const { return numDocuments_; }
+    bool flush();
+
+    // The text put without opening a file is kept in the buffer and can be taken by this function
+    void takeText(std::vector<char>& out_text);
+
+private:
+    void putVector3(const char* key, const cnoid::Vector3& v);
+    void putDouble(double value);
+    void putString(const char* str);
+    void putString(const char* str, size_t size);
+
+    std::FILE* file;
+    std::vector<char> buf;
+    int numDocuments_;
+    bool hasError;
+};
+
+#endif // DEVGUIDE_PLUGIN_BODY_POSITION_WRITER_H
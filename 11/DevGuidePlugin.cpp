@@ -1,15 +1,37 @@
 #include "BodyPositionItem.h"
 #include "BodyPositionItemView.h"
+#include "BodyPositionFileSaver.h"
+#include "BodyPositionFileWatcher.h"
+#include "BodyPositionImporter.h"
+#include "BodyPositionDeduplicator.h"
+#include "BodyPositionKeyframePlayer.h"
+#include "BodyPositionRecorder.h"
+#include "PoseStreamItem.h"
+#include "BodyPositionSpatialIndex.h"
+#include "BodyPositionTrace.h"
 #include <cnoid/Plugin>
 #include <cnoid/ViewManager>
 #include <cnoid/ToolBar>
-#include <cnoid/RootItem>
+#include <cnoid/MenuManager>
+#include <cnoid/FileDialog>
+#include <cnoid/MessageView>
 #include <cnoid/ItemList>
+#include <fmt/format.h>
+#include <chrono>
+#include <cstdlib>
+#ifdef DEV_GUIDE_ENABLE_BENCHMARKS
+#include "benchmark/ItemBenchmark.h"
+#endif
 
+using namespace std;
+using namespace fmt;
 using namespace cnoid;
 
 class DevGuidePlugin : public Plugin
 {
+    // The trace is written to this file at the exit when it is given by the environment variable
+    string traceFileAtExit;
+
 public:
     DevGuidePlugin()
         : Plugin("DevGuide")
@@ -17,9 +39,22 @@ public:
         require("Body");
     }
         
+    /**
+       Only the classes, the toolbar and the menu items are registered here. The widgets of
+       the view and the panels, the index of the items and the file watching are created when
+       they are first used.
+    */
     virtual bool initialize() override
     {
+        auto startTime = chrono::steady_clock::now();
+        if(auto traceFile = getenv("CNOID_BODY_POSITION_TRACE")){
+            traceFileAtExit = traceFile;
+            BodyPositionTrace::setEnabled(true);
+        }
+        BodyPositionTrace::Span span("DevGuidePlugin::initialize");
+
         BodyPositionItem::initializeClass(this);
+        PoseStreamItem::initializeClass(this);
 
         viewManager().registerClass<BodyPositionItemView>(
             "BodyPositionItemView", "Body Position Items");
@@ -29,25 +64,144 @@ public:
             [this](){ storeBodyPositions(); });
         toolBar->addButton("Restore Body Positions")->sigClicked().connect(
             [this](){ restoreBodyPositions(); });
+        toolBar->addButton("Restore Nearest")->sigClicked().connect(
+            [](){ BodyPositionSpatialIndex::restoreNearestBodyPositions(); });
+        toolBar->addButton("Import Body Positions")->sigClicked().connect(
+            [](){ BodyPositionImporter::importWithDialog(); });
+        toolBar->addButton("Remove Duplicates")->sigClicked().connect(
+            [](){ BodyPositionDeduplicator::deduplicateWithDialog(); });
+        toolBar->addSeparator();
+        toolBar->addToggleButton("Keyframe Playback")->sigToggled().connect(
+            [](bool on){ BodyPositionKeyframePlayer::instance()->setEnabled(on); });
+        auto recordingToggle = toolBar->addToggleButton("Record Poses");
+        recordingToggle->sigToggled().connect(
+            [recordingToggle](bool on){ onRecordingToggled(recordingToggle, on); });
         toolBar->setVisibleByDefault();
         addToolBar(toolBar);
 
+        auto& tm = menuManager().setPath("/Tools").setPath("Body Position");
+        tm.addItem("Convert Pose Recording to Body Positions...")->sigTriggered().connect(
+            [](){ BodyPositionRecorder::convertRecordingWithDialog(false); });
+        tm.addItem("Convert Pose Recording to Body Motions...")->sigTriggered().connect(
+            [](){ BodyPositionRecorder::convertRecordingWithDialog(true); });
+        tm.addItem("Convert Body Motions to Pose Streams...")->sigTriggered().connect(
+            [](){ PoseStreamItem::convertBodyMotionWithDialog(); });
+        tm.addItem("Convert Body Positions to Pose Streams...")->sigTriggered().connect(
+            [](){ PoseStreamItem::convertBodyPositionsWithDialog(); });
+        tm.addItem("Encode Pose Streams...")->sigTriggered().connect(
+            [](){ PoseStreamItem::encodeWithDialog(); });
+
+        auto& mm = menuManager().setPath("/Options").setPath("Body Position");
+        auto lazyLoadingCheck = mm.addCheckItem("Lazy loading of position files");
+        lazyLoadingCheck->setChecked(BodyPositionItem::isLazyLoadingEnabled());
+        lazyLoadingCheck->sigToggled().connect(
+            [](bool on){ BodyPositionItem::setLazyLoadingEnabled(on); });
+
+        auto saver = BodyPositionFileSaver::instance();
+        auto backgroundSavingCheck = mm.addCheckItem("Background saving of position files");
+        backgroundSavingCheck->setChecked(saver->isEnabled());
+        backgroundSavingCheck->sigToggled().connect(
+            [saver](bool on){ saver->setEnabled(on); });
+        auto autoSavingCheck = mm.addCheckItem("Save position files automatically after edits");
+        autoSavingCheck->setChecked(saver->isAutoSavingEnabled());
+        autoSavingCheck->sigToggled().connect(
+            [saver](bool on){ saver->setAutoSavingEnabled(on); });
+
+        auto watcher = BodyPositionFileWatcher::instance();
+        auto reloadingCheck = mm.addCheckItem("Reload position files updated by other programs");
+        reloadingCheck->setChecked(watcher->isEnabled());
+        reloadingCheck->sigToggled().connect(
+            [watcher](bool on){ watcher->setEnabled(on); });
+
+        mm.addItem("Keyframe Interval...")->sigTriggered().connect(
+            [](){ BodyPositionKeyframePlayer::setKeyIntervalWithDialog(); });
+
+        auto traceCheck = mm.addCheckItem("Trace plugin operations");
+        traceCheck->setChecked(BodyPositionTrace::isEnabled());
+        traceCheck->sigToggled().connect(
+            [](bool on){ BodyPositionTrace::setEnabled(on); });
+        mm.addItem("Save Trace...")->sigTriggered().connect(
+            [this](){ saveTraceWithDialog(); });
+
+#ifdef DEV_GUIDE_ENABLE_BENCHMARKS
+        BodyPositionBenchmark::initializeClass(this);
+#endif
+
+        if(BodyPositionTrace::isEnabled()){
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - startTime;
+            mvout() << format("The DevGuide plugin has been initialized in {0:.3f} ms.", elapsed.count())
+                    << endl;
+        }
+
+        return true;
+    }
+
+    virtual bool finalize() override
+    {
+        if(BodyPositionRecorder::instance()->isRecording()){
+            BodyPositionRecorder::instance()->stopRecording(mvout());
+        }
+        BodyPositionKeyframePlayer::instance()->setEnabled(false);
+        BodyPositionFileSaver::instance()->finalize();
+        BodyPositionFileWatcher::instance()->finalize();
+        if(!traceFileAtExit.empty()){
+            BodyPositionTrace::writeChromeTraceFile(traceFileAtExit);
+        }
         return true;
     }
             
     void storeBodyPositions()
     {
-        for(auto& item : RootItem::instance()->selectedItems<BodyPositionItem>()){
+        BodyPositionTrace::Span span("DevGuidePlugin::storeBodyPositions");
+        for(auto item = BodyPositionItem::firstSelectedRegisteredItem(); item;
+            item = item->nextSelectedRegisteredItem()){
             item->storeBodyPosition();
         }
     }
     
     void restoreBodyPositions()
     {
-        for(auto& item : RootItem::instance()->selectedItems<BodyPositionItem>()){
+        BodyPositionTrace::Span span("DevGuidePlugin::restoreBodyPositions");
+        for(auto item = BodyPositionItem::firstSelectedRegisteredItem(); item;
+            item = item->nextSelectedRegisteredItem()){
             item->restoreBodyPosition();
         }
     }
+
+    static void onRecordingToggled(ToolButton* toggle, bool on)
+    {
+        auto recorder = BodyPositionRecorder::instance();
+        if(on){
+            if(!recorder->isRecording() && !BodyPositionRecorder::startRecordingWithDialog()){
+                toggle->blockSignals(true);
+                toggle->setChecked(false);
+                toggle->blockSignals(false);
+            }
+        } else {
+            recorder->stopRecording(mvout());
+        }
+    }
+
+    void saveTraceWithDialog()
+    {
+        FileDialog dialog;
+        dialog.setWindowTitle("Save Trace");
+        dialog.setFileMode(QFileDialog::AnyFile);
+        dialog.setAcceptMode(QFileDialog::AcceptSave);
+        dialog.setViewMode(QFileDialog::List);
+        dialog.setLabelText(QFileDialog::Accept, "Save");
+        dialog.setNameFilters({ "Chrome trace files (*.json)", "Any files (*)" });
+        dialog.updatePresetDirectories();
+        if(dialog.exec() != QDialog::Accepted || dialog.selectedFiles().isEmpty()){
+            return;
+        }
+        string filename = dialog.selectedFiles().front().toStdString();
+        if(BodyPositionTrace::writeChromeTraceFile(filename)){
+            mvout() << format("The trace has been saved to \"{0}\".", filename) << endl;
+        } else {
+            mvout() << format("Failed to save the trace to \"{0}\".", filename) << endl;
+        }
+    }
 };
 
 CNOID_IMPLEMENT_PLUGIN_ENTRY(DevGuidePlugin)
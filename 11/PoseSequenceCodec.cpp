@@ -0,0 +1,402 @@
+#include "PoseSequenceCodec.h"
+#include "PoseStreamFormat.h"
+#include "BodyPositionTrace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+/**
+   The file consists of the header, the names of the bodies in the same form as the pose stream
+   files and the blocks. The channels of a block are the time and the seven values of each body,
+   which are the x, y, z translation, the index of the largest quaternion component and the other
+   three components. A block has the descriptors of the channels followed by the packed
+   differences of the channels, and the file ends with the padding for the unaligned reading of
+   the last packed values.
+*/
+struct PoseSequenceHeader
+{
+    char signature[8];
+    uint32_t version;
+    uint32_t numBodies;
+    uint64_t numFrames;
+    uint32_t blockSize;
+    uint32_t dataOffset;
+    double timeStep;
+    double translationStep;
+    double rotationStep;
+};
+
+static_assert(sizeof(PoseSequenceHeader) == 56, "The size of PoseSequenceHeader must be 56 bytes");
+
+const char PoseSequenceSignature[8] = { 'B', 'P', 'O', 'S', 'S', 'E', 'Q', '1' };
+const uint32_t PoseSequenceVersion = 1;
+const uint32_t BlockSize = 128;
+const double TimeStep = 1.0e-6;
+const int ChannelsPerPose = 7;
+const size_t DescriptorSize = 2 * sizeof(int64_t) + 1;
+const size_t PaddingSize = 8;
+
+// The differences of the quantized values are kept within 43 bits by this limit
+const double MaxQuantizedValue = 1099511627776.0; // 2^40
+const int MaxPackingWidth = 56;
+const uint32_t MaxBlockSize = 65536;
+
+// The position of each quaternion component in the largest component and the other three
+const int componentPositions[4][4] = {
+    { 3, 0, 1, 2 }, { 0, 3, 1, 2 }, { 0, 1, 3, 2 }, { 0, 1, 2, 3 } };
+
+int getWidth(uint64_t range)
+{
+    int width = 0;
+    while(range){
+        ++width;
+        range >>= 1;
+    }
+    return width;
+}
+
+size_t getPackedSize(int numValues, int width)
+{
+    return (static_cast<uint64_t>(numValues) * width + 7) / 8;
+}
+
+void appendValue(string& data, const void* value, size_t size)
+{
+    data.append(reinterpret_cast<const char*>(value), size);
+}
+
+bool quantize(double value, double step, int64_t& out_value)
+{
+    double q = std::round(value / step);
+    if(!(std::fabs(q) <= MaxQuantizedValue)){
+        return false;
+    }
+    out_value = static_cast<int64_t>(q);
+    return true;
+}
+
+}
+
+PoseSequenceCodec::PoseSequenceCodec()
+{
+    translationTolerance_ = 1.0e-4;
+    rotationTolerance_ = 1.0e-3;
+}
+
+void PoseSequenceCodec::setTranslationTolerance(double tolerance)
+{
+    translationTolerance_ = std::max(tolerance, 1.0e-6);
+}
+
+void PoseSequenceCodec::setRotationTolerance(double tolerance)
+{
+    rotationTolerance_ = std::max(tolerance, 1.0e-6);
+}
+
+bool PoseSequenceCodec::encode
+(const std::vector<std::string>& bodyNames, const double* frames, uint64_t numFrames,
+ std::string& out_data, std::string& out_error) const
+{
+    BodyPositionTrace::Span span("PoseSequenceCodec::encode");
+
+    PoseSequenceHeader header;
+    std::memcpy(header.signature, PoseSequenceSignature, sizeof(header.signature));
+    header.version = PoseSequenceVersion;
+    header.numBodies = bodyNames.size();
+    header.numFrames = numFrames;
+    header.blockSize = BlockSize;
+    size_t offset = sizeof(header);
+    for(auto& name : bodyNames){
+        offset += sizeof(uint32_t) + name.size();
+    }
+    header.dataOffset = (offset + 7) & ~size_t(7);
+    header.timeStep = TimeStep;
+    // The rounding error is a half of the step
+    header.translationStep = 2.0 * translationTolerance_;
+    /*
+      The error of each stored component is at most a quarter of the tolerance, and the error of
+      the restored largest component is at most about three times it. The angle is twice the
+      norm of the quaternion error, so the angle error is kept within the tolerance.
+    */
+    header.rotationStep = rotationTolerance_ / 4.0;
+
+    // The values are quantized channel by channel so that a block of a channel is contiguous
+    const int frameLength = 1 + PoseStreamValuesPerPose * header.numBodies;
+    const int numChannels = 1 + ChannelsPerPose * header.numBodies;
+    vector<int64_t> values(static_cast<size_t>(numChannels) * numFrames);
+    auto channel = [&](int c){ return &values[static_cast<size_t>(c) * numFrames]; };
+    bool isInRange = true;
+    for(uint64_t i=0; i < numFrames; ++i){
+        const double* v = frames + i * frameLength;
+        isInRange &= quantize(v[0], header.timeStep, channel(0)[i]);
+        for(uint32_t j=0; j < header.numBodies; ++j){
+            const double* p = v + 1 + j * PoseStreamValuesPerPose;
+            int c = 1 + j * ChannelsPerPose;
+            for(int k=0; k < 3; ++k){
+                isInRange &= quantize(p[k], header.translationStep, channel(c + k)[i]);
+            }
+            const double* q = p + 3;
+            double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+            if(!(norm > 0.0)){
+                out_error = "A rotation of the sequence is not valid.";
+                return false;
+            }
+            int largest = 0;
+            for(int k=1; k < 4; ++k){
+                if(std::fabs(q[k]) > std::fabs(q[largest])){
+                    largest = k;
+                }
+            }
+            // The largest component is restored as a positive value because q and -q are the same
+            double scale = (q[largest] < 0.0 ? -1.0 : 1.0) / norm;
+            channel(c + 3)[i] = largest;
+            int m = 4;
+            for(int k=0; k < 4; ++k){
+                if(k != largest){
+                    isInRange &= quantize(scale * q[k], header.rotationStep, channel(c + m)[i]);
+                    ++m;
+                }
+            }
+        }
+    }
+    if(!isInRange){
+        out_error = "A value of the sequence is out of the range of the encoding.";
+        return false;
+    }
+
+    out_data.clear();
+    appendValue(out_data, &header, sizeof(header));
+    for(auto& name : bodyNames){
+        uint32_t length = name.size();
+        appendValue(out_data, &length, sizeof(length));
+        out_data.append(name);
+    }
+    out_data.resize(header.dataOffset, '\0');
+
+    vector<int> widths(numChannels);
+    vector<int64_t> minDeltas(numChannels);
+    for(uint64_t blockBegin = 0; blockBegin < numFrames; blockBegin += BlockSize){
+        int n = std::min(static_cast<uint64_t>(BlockSize), numFrames - blockBegin);
+        for(int c=0; c < numChannels; ++c){
+            const int64_t* x = channel(c) + blockBegin;
+            int64_t minDelta = 0;
+            int64_t maxDelta = 0;
+            for(int i=1; i < n; ++i){
+                int64_t delta = x[i] - x[i - 1];
+                if(i == 1 || delta < minDelta){
+                    minDelta = delta;
+                }
+                if(i == 1 || delta > maxDelta){
+                    maxDelta = delta;
+                }
+            }
+            minDeltas[c] = minDelta;
+            widths[c] = getWidth(static_cast<uint64_t>(maxDelta - minDelta));
+            appendValue(out_data, &x[0], sizeof(int64_t));
+            appendValue(out_data, &minDelta, sizeof(int64_t));
+            out_data.push_back(static_cast<char>(widths[c]));
+        }
+        for(int c=0; c < numChannels; ++c){
+            const int64_t* x = channel(c) + blockBegin;
+            const int width = widths[c];
+            size_t begin = out_data.size();
+            // The extra bytes are for the unaligned writing of the last values
+            out_data.resize(begin + getPackedSize(n - 1, width) + PaddingSize, '\0');
+            auto packed = reinterpret_cast<unsigned char*>(&out_data[begin]);
+            for(int i=1; i < n; ++i){
+                uint64_t value = static_cast<uint64_t>(x[i] - x[i - 1] - minDeltas[c]);
+                uint64_t bit = static_cast<uint64_t>(i - 1) * width;
+                uint64_t word;
+                std::memcpy(&word, packed + (bit >> 3), sizeof(word));
+                word |= value << (bit & 7);
+                std::memcpy(packed + (bit >> 3), &word, sizeof(word));
+            }
+            out_data.resize(begin + getPackedSize(n - 1, width));
+        }
+    }
+    out_data.append(PaddingSize, '\0');
+
+    return true;
+}
+
+bool PoseSequenceCodec::writeFile
+(const std::string& filename, const std::vector<std::string>& bodyNames,
+ const double* frames, uint64_t numFrames, std::string& out_error) const
+{
+    string data;
+    if(!encode(bodyNames, frames, numFrames, data, out_error)){
+        return false;
+    }
+    auto fp = std::fopen(filename.c_str(), "wb");
+    if(!fp){
+        out_error = "The file cannot be created.";
+        return false;
+    }
+    bool written = (std::fwrite(data.data(), 1, data.size(), fp) == data.size());
+    if(std::fclose(fp) != 0 || !written){
+        out_error = "The file cannot be written.";
+        return false;
+    }
+    return true;
+}
+
+bool PoseSequenceCodec::isEncodedData(const char* data, size_t size)
+{
+    return size >= sizeof(PoseSequenceSignature) &&
+        std::memcmp(data, PoseSequenceSignature, sizeof(PoseSequenceSignature)) == 0;
+}
+
+bool PoseSequenceCodec::decode
+(const char* data, size_t size, std::vector<std::string>& out_bodyNames,
+ std::vector<double>& out_frames, std::string& out_error)
+{
+    BodyPositionTrace::Span span("PoseSequenceCodec::decode");
+
+    PoseSequenceHeader header;
+    if(size < sizeof(header) + PaddingSize || !isEncodedData(data, size)){
+        out_error = "The file is not an encoded pose sequence file.";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if(header.version != PoseSequenceVersion){
+        out_error = "The version of the file is not supported.";
+        return false;
+    }
+    const size_t dataEnd = size - PaddingSize;
+    const uint64_t numChannels = 1 + ChannelsPerPose * static_cast<uint64_t>(header.numBodies);
+    const uint64_t numBlocks = header.blockSize ? (header.numFrames + header.blockSize - 1) / header.blockSize : 0;
+    if(header.blockSize == 0 || header.blockSize > MaxBlockSize || header.dataOffset > dataEnd ||
+       numBlocks > (dataEnd - header.dataOffset) / (numChannels * DescriptorSize)){
+        out_error = "The header of the file is broken.";
+        return false;
+    }
+    out_bodyNames.clear();
+    size_t offset = sizeof(header);
+    for(uint32_t i=0; i < header.numBodies; ++i){
+        uint32_t length;
+        if(offset + sizeof(length) > header.dataOffset){
+            out_error = "The body names of the file are broken.";
+            return false;
+        }
+        std::memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length);
+        if(offset + length > header.dataOffset){
+            out_error = "The body names of the file are broken.";
+            return false;
+        }
+        out_bodyNames.emplace_back(data + offset, length);
+        offset += length;
+    }
+
+    const int frameLength = 1 + PoseStreamValuesPerPose * header.numBodies;
+    out_frames.resize(header.numFrames * frameLength);
+
+    // A block is decoded into these channel arrays and then interleaved into the frames
+    const int blockSize = header.blockSize;
+    vector<uint64_t> deltas(blockSize);
+    vector<uint64_t> integers(blockSize);
+    vector<double> reals(numChannels * blockSize);
+    vector<int> widths(numChannels);
+    vector<int64_t> bases(numChannels);
+    vector<int64_t> minDeltas(numChannels);
+    auto packed = reinterpret_cast<const unsigned char*>(data);
+    offset = header.dataOffset;
+
+    for(uint64_t blockBegin = 0; blockBegin < header.numFrames; blockBegin += blockSize){
+        const int n = std::min(static_cast<uint64_t>(blockSize), header.numFrames - blockBegin);
+        if(offset + numChannels * DescriptorSize > dataEnd){
+            out_error = "The data of the file is broken.";
+            return false;
+        }
+        size_t packedEnd = offset + numChannels * DescriptorSize;
+        for(uint64_t c=0; c < numChannels; ++c){
+            std::memcpy(&bases[c], data + offset, sizeof(int64_t));
+            std::memcpy(&minDeltas[c], data + offset + sizeof(int64_t), sizeof(int64_t));
+            widths[c] = static_cast<unsigned char>(data[offset + 2 * sizeof(int64_t)]);
+            offset += DescriptorSize;
+            if(widths[c] > MaxPackingWidth){
+                out_error = "The data of the file is broken.";
+                return false;
+            }
+            packedEnd += getPackedSize(n - 1, widths[c]);
+        }
+        if(packedEnd > dataEnd){
+            out_error = "The data of the file is broken.";
+            return false;
+        }
+
+        for(uint64_t c=0; c < numChannels; ++c){
+            const int width = widths[c];
+            const uint64_t mask = width ? (~uint64_t(0) >> (64 - width)) : 0;
+            const unsigned char* p = packed + offset;
+            uint64_t* d = deltas.data();
+            // Each value is read by an unaligned load independently of the others
+            for(int i=0; i < n - 1; ++i){
+                uint64_t bit = static_cast<uint64_t>(i) * width;
+                uint64_t word;
+                std::memcpy(&word, p + (bit >> 3), sizeof(word));
+                d[i] = (word >> (bit & 7)) & mask;
+            }
+            offset += getPackedSize(n - 1, width);
+
+            // The sums are unsigned so that broken data does not overflow
+            uint64_t* x = integers.data();
+            x[0] = bases[c];
+            const uint64_t minDelta = minDeltas[c];
+            for(int i=1; i < n; ++i){
+                x[i] = x[i - 1] + minDelta + d[i - 1];
+            }
+            double step;
+            if(c == 0){
+                step = header.timeStep;
+            } else {
+                int k = (c - 1) % ChannelsPerPose;
+                step = (k < 3) ? header.translationStep : (k == 3 ? 1.0 : header.rotationStep);
+            }
+            double* y = &reals[c * blockSize];
+            for(int i=0; i < n; ++i){
+                y[i] = static_cast<int64_t>(x[i]) * step;
+            }
+        }
+
+        double* frames = &out_frames[blockBegin * frameLength];
+        const double* times = &reals[0];
+        for(int i=0; i < n; ++i){
+            frames[i * frameLength] = times[i];
+        }
+        for(uint32_t j=0; j < header.numBodies; ++j){
+            const double* channels = &reals[(1 + j * ChannelsPerPose) * blockSize];
+            const double* tx = channels;
+            const double* ty = channels + blockSize;
+            const double* tz = channels + 2 * blockSize;
+            const double* largest = channels + 3 * blockSize;
+            const double* a = channels + 4 * blockSize;
+            const double* b = channels + 5 * blockSize;
+            const double* c = channels + 6 * blockSize;
+            double* pose = frames + 1 + j * PoseStreamValuesPerPose;
+            for(int i=0; i < n; ++i){
+                double* v = pose + i * frameLength;
+                v[0] = tx[i];
+                v[1] = ty[i];
+                v[2] = tz[i];
+                double components[4];
+                components[0] = a[i];
+                components[1] = b[i];
+                components[2] = c[i];
+                components[3] = std::sqrt(std::max(0.0, 1.0 - a[i] * a[i] - b[i] * b[i] - c[i] * c[i]));
+                const int* positions = componentPositions[static_cast<int>(largest[i]) & 3];
+                v[3] = components[positions[0]];
+                v[4] = components[positions[1]];
+                v[5] = components[positions[2]];
+                v[6] = components[positions[3]];
+            }
+        }
+    }
+
+    return true;
+}
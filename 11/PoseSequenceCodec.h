@@ -0,0 +1,46 @@
+#ifndef DEVGUIDE_PLUGIN_POSE_SEQUENCE_CODEC_H
+#define DEVGUIDE_PLUGIN_POSE_SEQUENCE_CODEC_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+   This class encodes the frames of a pose stream into a compact binary form within the given
+   error bounds, and decodes them to the frames of a pose stream. See PoseStreamFormat.h for the
+   layout of the frames.
+
+   The time and the translation are quantized to fixed-point values. The rotation is quantized
+   as the three smallest components of the quaternion and the index of the largest one. The
+   frames are divided into blocks, and each value of a block is stored as the difference from
+   the previous frame in the bits needed for the range of the differences in the block. The
+   decoding unpacks a block channel by channel, and the packed values of a channel are read
+   independently of each other so that the unpacking loop is vectorized by the compiler.
+*/
+class PoseSequenceCodec
+{
+public:
+    PoseSequenceCodec();
+
+    // The maximum error of each translation element in meter
+    void setTranslationTolerance(double tolerance);
+    double translationTolerance() const { return translationTolerance_; }
+    // The maximum angle between the original and decoded rotations in radian
+    void setRotationTolerance(double tolerance);
+    double rotationTolerance() const { return rotationTolerance_; }
+
+    bool encode(const std::vector<std::string>& bodyNames, const double* frames, uint64_t numFrames,
+                std::string& out_data, std::string& out_error) const;
+    bool writeFile(const std::string& filename, const std::vector<std::string>& bodyNames,
+                   const double* frames, uint64_t numFrames, std::string& out_error) const;
+
+    static bool isEncodedData(const char* data, size_t size);
+    static bool decode(const char* data, size_t size, std::vector<std::string>& out_bodyNames,
+                       std::vector<double>& out_frames, std::string& out_error);
+
+private:
+    double translationTolerance_;
+    double rotationTolerance_;
+};
+
+#endif // DEVGUIDE_PLUGIN_POSE_SEQUENCE_CODEC_H
@@ -0,0 +1,127 @@
+#ifndef DEVGUIDE_PLUGIN_POSE_STREAM_FORMAT_H
+#define DEVGUIDE_PLUGIN_POSE_STREAM_FORMAT_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+/**
+   A pose stream file records the root link poses of bodies in frames of a fixed size.
+
+   The file consists of the header, the names of the bodies and the frames. Each name is stored
+   as its length in a 32-bit unsigned integer followed by the characters, and the frames begin
+   at the data offset, which is aligned to 8 bytes. A frame consists of the time and the poses
+   of the bodies. A pose is the x, y, z translation and the x, y, z, w quaternion. All the
+   values are 64-bit floating point values. The file is written in the native byte order of the
+   host because the frames are read in place, so a file written on a host of the other byte order
+   is rejected.
+
+   The number of frames is zero when the recording was not finished properly. The frames are
+   then counted from the size of the file.
+*/
+struct PoseStreamHeader
+{
+    char signature[8];
+    uint32_t version;
+    uint32_t numBodies;
+    uint32_t frameSize;
+    uint32_t dataOffset;
+    uint64_t numFrames;
+};
+
+static_assert(sizeof(PoseStreamHeader) == 32, "The size of PoseStreamHeader must be 32 bytes");
+
+const char PoseStreamSignature[8] = { 'B', 'P', 'O', 'S', 'S', 'T', 'R', '1' };
+const uint32_t PoseStreamVersion = 1;
+// The version read from a file written in the other byte order
+const uint32_t PoseStreamSwappedVersion =
+    (PoseStreamVersion << 24) | ((PoseStreamVersion << 8) & 0xff0000) |
+    ((PoseStreamVersion >> 8) & 0xff00) | (PoseStreamVersion >> 24);
+const int PoseStreamValuesPerPose = 7;
+
+inline uint32_t getPoseStreamFrameSize(uint32_t numBodies)
+{
+    return sizeof(double) * (1 + PoseStreamValuesPerPose * numBodies);
+}
+
+inline bool writePoseStreamHeader
+(std::FILE* fp, const std::vector<std::string>& bodyNames, uint64_t numFrames)
+{
+    PoseStreamHeader header;
+    std::memcpy(header.signature, PoseStreamSignature, sizeof(header.signature));
+    header.version = PoseStreamVersion;
+    header.numBodies = bodyNames.size();
+    header.frameSize = getPoseStreamFrameSize(header.numBodies);
+    size_t offset = sizeof(header);
+    for(auto& name : bodyNames){
+        offset += sizeof(uint32_t) + name.size();
+    }
+    header.dataOffset = (offset + 7) & ~size_t(7);
+    header.numFrames = numFrames;
+
+    bool written = (std::fwrite(&header, sizeof(header), 1, fp) == 1);
+    for(auto& name : bodyNames){
+        uint32_t length = name.size();
+        written &= (std::fwrite(&length, sizeof(length), 1, fp) == 1);
+        written &= (std::fwrite(name.data(), 1, length, fp) == length);
+    }
+    static const char padding[8] = { 0 };
+    size_t paddingSize = header.dataOffset - offset;
+    written &= (std::fwrite(padding, 1, paddingSize, fp) == paddingSize);
+    return written;
+}
+
+// The header and the names are read from a memory block of the given size
+inline bool readPoseStreamHeader
+(const char* data, size_t size, PoseStreamHeader& out_header, std::vector<std::string>& out_bodyNames,
+ std::string& out_error)
+{
+    if(size < sizeof(PoseStreamHeader)){
+        out_error = "The file is too short.";
+        return false;
+    }
+    std::memcpy(&out_header, data, sizeof(PoseStreamHeader));
+    if(std::memcmp(out_header.signature, PoseStreamSignature, sizeof(PoseStreamSignature)) != 0){
+        out_error = "The file is not a pose stream file.";
+        return false;
+    }
+    if(out_header.version == PoseStreamSwappedVersion){
+        out_error = "The file was written in the other byte order.";
+        return false;
+    }
+    if(out_header.version != PoseStreamVersion){
+        out_error = "The version of the file is not supported.";
+        return false;
+    }
+    if(out_header.frameSize != getPoseStreamFrameSize(out_header.numBodies) ||
+       out_header.dataOffset > size || out_header.dataOffset % 8 != 0){
+        out_error = "The header of the file is broken.";
+        return false;
+    }
+    out_bodyNames.clear();
+    size_t offset = sizeof(PoseStreamHeader);
+    for(uint32_t i=0; i < out_header.numBodies; ++i){
+        uint32_t length;
+        if(offset + sizeof(length) > out_header.dataOffset){
+            out_error = "The body names of the file are broken.";
+            return false;
+        }
+        std::memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length);
+        if(offset + length > out_header.dataOffset){
+            out_error = "The body names of the file are broken.";
+            return false;
+        }
+        out_bodyNames.emplace_back(data + offset, length);
+        offset += length;
+    }
+    uint64_t numStoredFrames = (size - out_header.dataOffset) / out_header.frameSize;
+    if(out_header.numFrames == 0 || out_header.numFrames > numStoredFrames){
+        out_header.numFrames = numStoredFrames;
+    }
+    return true;
+}
+
+#endif // DEVGUIDE_PLUGIN_POSE_STREAM_FORMAT_H
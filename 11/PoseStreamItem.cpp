@@ -0,0 +1,486 @@
+#include "PoseStreamItem.h"
+#include "BodyPositionItem.h"
+#include "BodyPositionKeyframePlayer.h"
+#include "BodyPositionTrace.h"
+#include <cnoid/ExtensionManager>
+#include <cnoid/ItemManager>
+#include <cnoid/ItemFileIO>
+#include <cnoid/RootItem>
+#include <cnoid/BodyMotionItem>
+#include <cnoid/TimeBar>
+#include <cnoid/FileDialog>
+#include <cnoid/MessageView>
+#include <cnoid/PutPropertyFunction>
+#include <cnoid/Archive>
+#include <cnoid/EigenUtil>
+#include <cnoid/stdx/filesystem>
+#include <QFile>
+#include <QBoxLayout>
+#include <QLabel>
+#include <QCheckBox>
+#include <QDoubleSpinBox>
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+
+namespace {
+
+class PoseStreamItemFileIO : public ItemFileIoBase<PoseStreamItem>
+{
+public:
+    PoseStreamItemFileIO()
+        : ItemFileIoBase<PoseStreamItem>("POSE-STREAM", Load)
+    {
+        setCaption("Pose Stream");
+        setExtensions({ "poses", "cposes" });
+    }
+
+    virtual bool load(PoseStreamItem* item, const std::string& filename) override
+    {
+        return item->load(filename, os());
+    }
+};
+
+void appendFrame(vector<double>& frames, double time, const Vector3& p, const Quaternion& q)
+{
+    frames.insert(frames.end(), { time, p.x(), p.y(), p.z(), q.x(), q.y(), q.z(), q.w() });
+}
+
+bool writeFrames
+(const string& filename, const vector<string>& bodyNames, const vector<double>& frames,
+ const PoseSequenceCodec* codec, ostream& os)
+{
+    uint64_t numFrames = frames.size() / (1 + PoseStreamValuesPerPose * bodyNames.size());
+    if(codec){
+        string error;
+        if(!codec->writeFile(filename, bodyNames, frames.data(), numFrames, error)){
+            os << format("Failed to write \"{0}\": {1}", filename, error) << endl;
+            return false;
+        }
+        return true;
+    }
+    auto fp = std::fopen(filename.c_str(), "wb");
+    if(!fp){
+        os << format("\"{0}\" cannot be created.", filename) << endl;
+        return false;
+    }
+    bool written =
+        writePoseStreamHeader(fp, bodyNames, numFrames) &&
+        std::fwrite(frames.data(), sizeof(double), frames.size(), fp) == frames.size();
+    if(std::fclose(fp) != 0 || !written){
+        os << format("Failed to write \"{0}\".", filename) << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+   The encoding and its tolerances are chosen in the option panel of the dialog. The encoding is
+   always applied if it is not optional.
+*/
+bool getOutputFilename
+(const string& title, bool isEncodingOptional, bool& io_isEncoded, PoseSequenceCodec& io_codec,
+ string& out_filename)
+{
+    FileDialog dialog;
+    dialog.setWindowTitle(title.c_str());
+    dialog.setFileMode(QFileDialog::AnyFile);
+    dialog.setAcceptMode(QFileDialog::AcceptSave);
+    dialog.setViewMode(QFileDialog::List);
+    dialog.setLabelText(QFileDialog::Accept, "Convert");
+    dialog.setNameFilters({ "Pose stream files (*.poses *.cposes)", "Any files (*)" });
+
+    auto panel = new QWidget;
+    auto hbox = new QHBoxLayout;
+    panel->setLayout(hbox);
+    auto encodingCheck = new QCheckBox("Encode");
+    encodingCheck->setChecked(io_isEncoded || !isEncodingOptional);
+    encodingCheck->setEnabled(isEncodingOptional);
+    hbox->addWidget(encodingCheck);
+    hbox->addWidget(new QLabel("Translation tolerance [mm]"));
+    auto translationSpin = new QDoubleSpinBox;
+    translationSpin->setDecimals(3);
+    translationSpin->setRange(0.001, 100.0);
+    translationSpin->setValue(io_codec.translationTolerance() * 1000.0);
+    hbox->addWidget(translationSpin);
+    hbox->addWidget(new QLabel("Rotation tolerance [deg]"));
+    auto rotationSpin = new QDoubleSpinBox;
+    rotationSpin->setDecimals(3);
+    rotationSpin->setRange(0.001, 10.0);
+    rotationSpin->setValue(degree(io_codec.rotationTolerance()));
+    hbox->addWidget(rotationSpin);
+    hbox->addStretch();
+    dialog.insertOptionPanel(panel);
+    dialog.updatePresetDirectories();
+
+    if(dialog.exec() != QDialog::Accepted || dialog.selectedFiles().isEmpty()){
+        return false;
+    }
+    io_isEncoded = encodingCheck->isChecked();
+    io_codec.setTranslationTolerance(translationSpin->value() / 1000.0);
+    io_codec.setRotationTolerance(radian(rotationSpin->value()));
+    out_filename = dialog.selectedFiles().front().toStdString();
+    if(stdx::filesystem::path(out_filename).extension().empty()){
+        out_filename += io_isEncoded ? ".cposes" : ".poses";
+    }
+    return true;
+}
+
+void insertPoseStreamItem(const string& filename, Item* parentItem, Item* nextItem)
+{
+    PoseStreamItemPtr item = new PoseStreamItem;
+    item->setName(stdx::filesystem::path(filename).stem().string());
+    if(item->load(filename, mvout())){
+        item->updateFileInformation(filename, "POSE-STREAM");
+        parentItem->insertChild(nextItem, item);
+    }
+}
+
+}
+
+void PoseStreamItem::initializeClass(cnoid::ExtensionManager* ext)
+{
+    ext->itemManager()
+        .registerClass<PoseStreamItem>("PoseStreamItem")
+        .addFileIO<PoseStreamItem>(new PoseStreamItemFileIO);
+}
+
+PoseStreamItem::PoseStreamItem()
+{
+    frames = nullptr;
+    isTargetBodyItemListDirty = true;
+}
+
+PoseStreamItem::PoseStreamItem(const PoseStreamItem& org)
+    : Item(org)
+{
+    frames = nullptr;
+    isTargetBodyItemListDirty = true;
+    if(org.isLoaded()){
+        load(org.filePath(), mvout());
+    }
+}
+
+PoseStreamItem::~PoseStreamItem()
+{
+    unload();
+}
+
+Item* PoseStreamItem::doDuplicate() const
+{
+    return new PoseStreamItem(*this);
+}
+
+bool PoseStreamItem::load(const std::string& filename, std::ostream& os)
+{
+    BodyPositionTrace::Span span("PoseStreamItem::load");
+    unload();
+    file.reset(new QFile(QString::fromStdString(filename)));
+    if(!file->open(QIODevice::ReadOnly)){
+        os << format("\"{0}\" cannot be opened.", filename) << endl;
+        file.reset();
+        return false;
+    }
+    // Only the pages of the header are read here
+    auto size = file->size();
+    auto data = reinterpret_cast<const char*>(file->map(0, size));
+    if(!data){
+        os << format("\"{0}\" cannot be mapped into memory.", filename) << endl;
+        file.reset();
+        return false;
+    }
+    string error;
+    if(PoseSequenceCodec::isEncodedData(data, size)){
+        // The mapping is not kept because the frames are decoded into memory
+        bool decoded = PoseSequenceCodec::decode(data, size, bodyNames_, decodedFrames, error);
+        file.reset();
+        if(!decoded || decodedFrames.empty()){
+            os << format("\"{0}\": {1}", filename, decoded ? "The file does not have any frame." : error)
+               << endl;
+            vector<double>().swap(decodedFrames);
+            return false;
+        }
+        std::memcpy(header.signature, PoseStreamSignature, sizeof(header.signature));
+        header.version = PoseStreamVersion;
+        header.numBodies = bodyNames_.size();
+        header.frameSize = getPoseStreamFrameSize(header.numBodies);
+        header.dataOffset = 0;
+        header.numFrames = decodedFrames.size() * sizeof(double) / header.frameSize;
+        frames = reinterpret_cast<const char*>(decodedFrames.data());
+    } else {
+        if(!readPoseStreamHeader(data, size, header, bodyNames_, error)){
+            os << format("\"{0}\": {1}", filename, error) << endl;
+            file.reset();
+            return false;
+        }
+        frames = data + header.dataOffset;
+    }
+    isTargetBodyItemListDirty = true;
+    return true;
+}
+
+void PoseStreamItem::unload()
+{
+    timeConnection.disconnect();
+    frames = nullptr;
+    bodyNames_.clear();
+    targetBodyItems.clear();
+    // The mapping is released when the file is closed
+    file.reset();
+    vector<double>().swap(decodedFrames);
+}
+
+double PoseStreamItem::frameTime(uint64_t frame) const
+{
+    return frameData(frame)[0];
+}
+
+uint64_t PoseStreamItem::findFrame(double time) const
+{
+    uint64_t lower = 0;
+    uint64_t upper = header.numFrames;
+    while(upper - lower > 1){
+        uint64_t middle = lower + (upper - lower) / 2;
+        if(frameTime(middle) <= time){
+            lower = middle;
+        } else {
+            upper = middle;
+        }
+    }
+    return lower;
+}
+
+Isometry3 PoseStreamItem::pose(uint64_t frame, int body) const
+{
+    const double* v = frameData(frame) + 1 + body * PoseStreamValuesPerPose;
+    Isometry3 T;
+    T.translation() << v[0], v[1], v[2];
+    T.linear() = Quaternion(v[6], v[3], v[4], v[5]).normalized().toRotationMatrix();
+    return T;
+}
+
+void PoseStreamItem::onConnectedToRoot()
+{
+    selectionConnection =
+        sigSelectionChanged().connect(
+            [this](bool on){ onSelectionChanged(on); });
+    treeConnection =
+        RootItem::instance()->sigTreeChanged().connect(
+            [this](){ isTargetBodyItemListDirty = true; });
+    isTargetBodyItemListDirty = true;
+    onSelectionChanged(isSelected());
+}
+
+void PoseStreamItem::onDisconnectedFromRoot()
+{
+    selectionConnection.disconnect();
+    treeConnection.disconnect();
+    timeConnection.disconnect();
+    targetBodyItems.clear();
+}
+
+void PoseStreamItem::onSelectionChanged(bool on)
+{
+    if(on && isLoaded()){
+        if(!timeConnection.connected()){
+            timeConnection =
+                TimeBar::instance()->sigTimeChanged().connect(
+                    [this](double time){ return onTimeChanged(time); });
+            onTimeChanged(TimeBar::instance()->time());
+        }
+    } else {
+        timeConnection.disconnect();
+    }
+}
+
+void PoseStreamItem::updateTargetBodyItems()
+{
+    isTargetBodyItemListDirty = false;
+    targetBodyItems.assign(bodyNames_.size(), nullptr);
+    if(bodyNames_.size() == 1){
+        if(auto ownerBodyItem = findOwnerItem<BodyItem>()){
+            targetBodyItems[0] = ownerBodyItem;
+            return;
+        }
+    }
+    for(auto& bodyItem : RootItem::instance()->descendantItems<BodyItem>()){
+        for(size_t i=0; i < bodyNames_.size(); ++i){
+            if(!targetBodyItems[i] && bodyItem->name() == bodyNames_[i]){
+                targetBodyItems[i] = bodyItem;
+                break;
+            }
+        }
+    }
+}
+
+bool PoseStreamItem::onTimeChanged(double time)
+{
+    BodyPositionTrace::Span span("PoseStreamItem::onTimeChanged");
+    if(!isLoaded() || header.numFrames == 0){
+        return false;
+    }
+    if(isTargetBodyItemListDirty){
+        updateTargetBodyItems();
+    }
+    uint64_t frame = findFrame(time);
+    for(size_t i=0; i < targetBodyItems.size(); ++i){
+        if(auto& bodyItem = targetBodyItems[i]){
+            bodyItem->body()->rootLink()->position() = pose(frame, i);
+            bodyItem->notifyKinematicStateChange(true);
+        }
+    }
+    return time < frameTime(header.numFrames - 1);
+}
+
+void PoseStreamItem::doPutProperties(cnoid::PutPropertyFunction& putProperty)
+{
+    putProperty("Bodies", numBodies());
+    putProperty("Frames", format("{0}", numFrames()));
+    if(numFrames() > 0){
+        putProperty("Time range", format("{0:.3f} - {1:.3f}", frameTime(0), frameTime(numFrames() - 1)));
+    }
+}
+
+bool PoseStreamItem::store(cnoid::Archive& archive)
+{
+    return archive.writeFileInformation(this);
+}
+
+bool PoseStreamItem::restore(const cnoid::Archive& archive)
+{
+    return archive.loadFileTo(this);
+}
+
+bool PoseStreamItem::writeBodyMotion
+(cnoid::BodyMotionItem* motionItem, const std::string& filename, std::ostream& os,
+ const PoseSequenceCodec* codec)
+{
+    BodyPositionTrace::Span span("PoseStreamItem::writeBodyMotion");
+    auto bodyItem = motionItem->findOwnerItem<BodyItem>();
+    auto seq = motionItem->motion()->positionSeq();
+    if(!bodyItem || seq->numFrames() == 0 || seq->numLinkPositionsHint() == 0){
+        os << format("{0} does not have the root link positions of a body.", motionItem->name()) << endl;
+        return false;
+    }
+    int numFrames = seq->numFrames();
+    double frameRate = seq->frameRate();
+    vector<double> frames;
+    frames.reserve(numFrames * (1 + PoseStreamValuesPerPose));
+    for(int i=0; i < numFrames; ++i){
+        auto position = seq->frame(i).linkPosition(0);
+        appendFrame(frames, i / frameRate, position.translation(), position.rotation());
+    }
+    return writeFrames(filename, { bodyItem->name() }, frames, codec, os);
+}
+
+bool PoseStreamItem::writeBodyPositions
+(cnoid::BodyItem* bodyItem, double keyInterval, const std::string& filename, std::ostream& os,
+ const PoseSequenceCodec* codec)
+{
+    BodyPositionTrace::Span span("PoseStreamItem::writeBodyPositions");
+    vector<double> frames;
+    int numKeys = 0;
+    for(auto& item : bodyItem->descendantItems<BodyPositionItem>()){
+        if(item->ownerBodyItem() == bodyItem){
+            item->ensureLoaded();
+            appendFrame(frames, numKeys++ * keyInterval, item->translation(), item->rotation());
+        }
+    }
+    if(numKeys == 0){
+        os << format("{0} does not have any body position item.", bodyItem->name()) << endl;
+        return false;
+    }
+    return writeFrames(filename, { bodyItem->name() }, frames, codec, os);
+}
+
+bool PoseStreamItem::writeEncodedFile
+(const std::string& filename, const PoseSequenceCodec& codec, std::ostream& os) const
+{
+    if(numFrames() == 0){
+        os << format("{0} does not have any frame.", name()) << endl;
+        return false;
+    }
+    string error;
+    if(!codec.writeFile(filename, bodyNames_, frameData(0), numFrames(), error)){
+        os << format("Failed to write \"{0}\": {1}", filename, error) << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+   Each selected body motion item is converted to a file, and the pose stream item of the
+   file is added next to the body motion item.
+*/
+void PoseStreamItem::convertBodyMotionWithDialog()
+{
+    auto motionItems = RootItem::instance()->selectedItems<BodyMotionItem>();
+    if(motionItems.empty()){
+        showWarningDialog("Select the body motion items to convert.");
+        return;
+    }
+    bool isEncoded = false;
+    PoseSequenceCodec codec;
+    for(auto& motionItem : motionItems){
+        string filename;
+        if(!getOutputFilename(format("Convert {0} to Pose Stream", motionItem->name()),
+                              true, isEncoded, codec, filename)){
+            return;
+        }
+        if(writeBodyMotion(motionItem, filename, mvout(), isEncoded ? &codec : nullptr)){
+            insertPoseStreamItem(filename, motionItem->parentItem(), motionItem->nextItem());
+        }
+    }
+}
+
+/**
+   The body position items of each selected body item are converted to a file at the key interval
+   of the keyframe playback, and the pose stream item of the file is added to the body item.
+*/
+void PoseStreamItem::convertBodyPositionsWithDialog()
+{
+    auto bodyItems = RootItem::instance()->selectedItems<BodyItem>();
+    if(bodyItems.empty()){
+        showWarningDialog("Select the body items whose body positions are converted.");
+        return;
+    }
+    bool isEncoded = false;
+    PoseSequenceCodec codec;
+    double keyInterval = BodyPositionKeyframePlayer::instance()->keyInterval();
+    for(auto& bodyItem : bodyItems){
+        string filename;
+        if(!getOutputFilename(format("Convert Body Positions of {0} to Pose Stream", bodyItem->name()),
+                              true, isEncoded, codec, filename)){
+            return;
+        }
+        if(writeBodyPositions(bodyItem, keyInterval, filename, mvout(), isEncoded ? &codec : nullptr)){
+            insertPoseStreamItem(filename, bodyItem, nullptr);
+        }
+    }
+}
+
+// Each selected pose stream item is encoded to a file, and the item of the file is added next to it
+void PoseStreamItem::encodeWithDialog()
+{
+    auto streamItems = RootItem::instance()->selectedItems<PoseStreamItem>();
+    if(streamItems.empty()){
+        showWarningDialog("Select the pose stream items to encode.");
+        return;
+    }
+    bool isEncoded = true;
+    PoseSequenceCodec codec;
+    for(auto& streamItem : streamItems){
+        string filename;
+        if(!getOutputFilename(format("Encode {0}", streamItem->name()), false, isEncoded, codec, filename)){
+            return;
+        }
+        if(streamItem->writeEncodedFile(filename, codec, mvout())){
+            insertPoseStreamItem(filename, streamItem->parentItem(), streamItem->nextItem());
+        }
+    }
+}
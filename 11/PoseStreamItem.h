@@ -0,0 +1,92 @@
+#ifndef DEVGUIDE_PLUGIN_POSE_STREAM_ITEM_H
+#define DEVGUIDE_PLUGIN_POSE_STREAM_ITEM_H
+
+#include "PoseStreamFormat.h"
+#include "PoseSequenceCodec.h"
+#include <cnoid/Item>
+#include <cnoid/BodyItem>
+#include <cnoid/EigenTypes>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace cnoid { class BodyMotionItem; }
+class QFile;
+
+/**
+   This item plays a pose stream file on the time bar while it is selected. The file is mapped
+   into memory and the frame for the current time is found by a binary search on the mapped
+   frames, so only the header and the body names are read when the file is loaded. A file
+   encoded by PoseSequenceCodec is decoded into memory when it is loaded.
+
+   The poses are applied to the body items in the project whose names match the names in the
+   file. A stream of a single body is applied to the owner body item of this item if there is.
+*/
+class PoseStreamItem : public cnoid::Item
+{
+public:
+    static void initializeClass(cnoid::ExtensionManager* ext);
+
+    PoseStreamItem();
+    PoseStreamItem(const PoseStreamItem& org);
+    virtual ~PoseStreamItem();
+
+    bool load(const std::string& filename, std::ostream& os);
+    void unload();
+    bool isLoaded() const { return frames != nullptr; }
+    int numBodies() const { return bodyNames_.size(); }
+    const std::vector<std::string>& bodyNames() const { return bodyNames_; }
+    uint64_t numFrames() const { return isLoaded() ? header.numFrames : 0; }
+    double frameTime(uint64_t frame) const;
+    // Returns the last frame whose time is not later than the time
+    uint64_t findFrame(double time) const;
+    cnoid::Isometry3 pose(uint64_t frame, int body) const;
+
+    /**
+       The root link positions of the body motion or the body position items owned by the body
+       item are written as a pose stream file. The body position items are put at the times of
+       the key interval. The file is encoded if the codec is given.
+    */
+    static bool writeBodyMotion(
+        cnoid::BodyMotionItem* motionItem, const std::string& filename, std::ostream& os,
+        const PoseSequenceCodec* codec = nullptr);
+    static bool writeBodyPositions(
+        cnoid::BodyItem* bodyItem, double keyInterval, const std::string& filename, std::ostream& os,
+        const PoseSequenceCodec* codec = nullptr);
+    bool writeEncodedFile(const std::string& filename, const PoseSequenceCodec& codec, std::ostream& os) const;
+
+    static void convertBodyMotionWithDialog();
+    static void convertBodyPositionsWithDialog();
+    static void encodeWithDialog();
+
+protected:
+    virtual Item* doDuplicate() const override;
+    virtual void doPutProperties(cnoid::PutPropertyFunction& putProperty) override;
+    virtual bool store(cnoid::Archive& archive) override;
+    virtual bool restore(const cnoid::Archive& archive) override;
+    virtual void onConnectedToRoot() override;
+    virtual void onDisconnectedFromRoot() override;
+
+private:
+    const double* frameData(uint64_t frame) const {
+        return reinterpret_cast<const double*>(frames + frame * header.frameSize); }
+    void onSelectionChanged(bool on);
+    void updateTargetBodyItems();
+    bool onTimeChanged(double time);
+
+    std::unique_ptr<QFile> file;
+    std::vector<double> decodedFrames;
+    const char* frames;
+    PoseStreamHeader header;
+    std::vector<std::string> bodyNames_;
+    std::vector<cnoid::BodyItemPtr> targetBodyItems;
+    bool isTargetBodyItemListDirty;
+    cnoid::ScopedConnection selectionConnection;
+    cnoid::ScopedConnection treeConnection;
+    cnoid::ScopedConnection timeConnection;
+};
+
+typedef cnoid::ref_ptr<PoseStreamItem> PoseStreamItemPtr;
+
+#endif // DEVGUIDE_PLUGIN_POSE_STREAM_ITEM_H
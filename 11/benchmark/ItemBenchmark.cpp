@@ -0,0 +1,308 @@
+#include "ItemBenchmark.h"
+#include "../BodyPositionItem.h"
+#include "../BodyPositionItemView.h"
+#include "../BodyPositionItemIndex.h"
+#include "../BodyPositionFileSaver.h"
+#include "../BodyPositionFileWatcher.h"
+#include <cnoid/RootItem>
+#include <cnoid/BodyItem>
+#include <cnoid/ViewManager>
+#include <cnoid/OptionManager>
+#include <cnoid/LazyCaller>
+#include <cnoid/MessageView>
+#include <cnoid/stdx/filesystem>
+#include <QCoreApplication>
+#include <fmt/format.h>
+#include <chrono>
+#include <sstream>
+#include <cstdio>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+namespace filesystem = cnoid::stdx::filesystem;
+
+namespace {
+
+string benchmarkOutputFile;
+
+const int itemCounts[] = { 10, 100, 1000, 10000 };
+
+// Returns -1 if the heap usage cannot be obtained
+double getHeapUsage()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return -1.0;
+#endif
+}
+
+}
+
+void BodyPositionBenchmark::initializeClass(ExtensionManager* ext)
+{
+    auto& om = ext->optionManager();
+    om.add_option("--body-position-benchmark", benchmarkOutputFile,
+                  "run the benchmarks of the body position items and write the results to a JSON file");
+    om.sigOptionsParsed(1).connect(
+        [](OptionManager*){
+            if(!benchmarkOutputFile.empty()){
+                // The benchmarks are run after the main window is shown
+                callLater([](){
+                    BodyPositionBenchmark benchmark;
+                    QCoreApplication::exit(benchmark.run(benchmarkOutputFile) ? 0 : 1);
+                });
+            }
+        });
+}
+
+bool BodyPositionBenchmark::run(const std::string& outputFile)
+{
+    // The file operations in the background are not measured
+    auto saver = BodyPositionFileSaver::instance();
+    auto watcher = BodyPositionFileWatcher::instance();
+    bool isSaverEnabled = saver->isEnabled();
+    bool isWatcherEnabled = watcher->isEnabled();
+    saver->setEnabled(false);
+    watcher->setEnabled(false);
+
+    measureFileIo();
+    measureFlagCreation();
+    measureStoreAndRestore();
+    measureDuplication();
+    measureViewUpdate();
+    measureIndexSearch();
+    measureMemoryUsage();
+
+    saver->setEnabled(isSaverEnabled);
+    watcher->setEnabled(isWatcherEnabled);
+
+    return writeResults(outputFile);
+}
+
+template<class Function>
+void BodyPositionBenchmark::measure(const std::string& name, int numItems, int numIterations, Function func)
+{
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i < numIterations; ++i){
+        func();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    results.push_back({ name, numItems, numIterations, elapsed.count() });
+
+    mvout() << format("{0} ({1} items): {2:.3f} us", name, numItems, elapsed.count() * 1.0e6 / numIterations)
+            << endl;
+}
+
+void BodyPositionBenchmark::measureFileIo()
+{
+    auto filename = (filesystem::temp_directory_path() / "body-position-benchmark.pos").string();
+    BodyPositionItemPtr item = new BodyPositionItem;
+    ostringstream os;
+
+    measure("saveBodyPosition", 1, 10000, [&](){
+        item->saveBodyPosition(filename, BodyPositionItem::Meter, BodyPositionItem::Degree, os); });
+    measure("loadBodyPosition", 1, 10000, [&](){
+        item->loadBodyPosition(filename, BodyPositionItem::Meter, BodyPositionItem::Degree, os); });
+
+    std::remove(filename.c_str());
+}
+
+void BodyPositionBenchmark::measureFlagCreation()
+{
+    BodyPositionItemPtr item = new BodyPositionItem;
+    item->getScene();
+    // The flag of an item with the scene is created again when the color is changed
+    int colorId = 0;
+    measure("setFlagColor.withScene", 1, 10000, [&](){
+        item->setFlagColor(++colorId % BodyPositionItem::NumFlagColors); });
+}
+
+void BodyPositionBenchmark::measureStoreAndRestore()
+{
+    BodyItemPtr bodyItem = new BodyItem;
+    bodyItem->setName("BenchmarkBody");
+    BodyPositionItemPtr item = new BodyPositionItem;
+    item->setName("BenchmarkPosition");
+    bodyItem->addChildItem(item);
+    RootItem::instance()->addChildItem(bodyItem);
+
+    measure("storeBodyPosition", 1, 1000, [&](){ item->storeBodyPosition(); });
+    measure("restoreBodyPosition", 1, 1000, [&](){ item->restoreBodyPosition(); });
+
+    bodyItem->removeFromParentItem();
+    QCoreApplication::processEvents();
+}
+
+void BodyPositionBenchmark::measureDuplication()
+{
+    BodyPositionItemPtr item = new BodyPositionItem;
+    measure("doDuplicate", 1, 10000, [&](){ ItemPtr duplicated = item->duplicate(); });
+}
+
+/**
+   The first update after the items are added creates the rows and the following updates
+   only check the rows. Both are measured in the row mode and the virtualized list mode.
+*/
+void BodyPositionBenchmark::measureViewUpdate()
+{
+    auto view = ViewManager::getOrCreateView<BodyPositionItemView>();
+    if(!view){
+        return;
+    }
+    bool orgListMode = view->isListMode();
+    auto orgTargetMode = view->targetMode();
+    view->setTargetMode(BodyPositionItemView::All);
+
+    for(auto numItems : itemCounts){
+        BodyItemPtr bodyItem = new BodyItem;
+        bodyItem->setName("BenchmarkBody");
+        BodyPositionItem::beginItemsInProjectChangeBatch();
+        for(int i=0; i < numItems; ++i){
+            auto item = new BodyPositionItem;
+            item->setName(format("Position{0}", i));
+            bodyItem->addChildItem(item);
+        }
+        RootItem::instance()->addChildItem(bodyItem);
+        BodyPositionItem::endItemsInProjectChangeBatch();
+        QCoreApplication::processEvents();
+
+        int numIterations = std::max(1, 10000 / numItems);
+        for(int listMode = 0; listMode < 2; ++listMode){
+            view->setListMode(listMode);
+            view->clearInterfaceUnits();
+            string mode = listMode ? "list" : "rows";
+            measure(format("updateTargetItems.{0}.first", mode), numItems, 1,
+                    [&](){ view->updateTargetItems(); });
+            measure(format("updateTargetItems.{0}", mode), numItems, numIterations,
+                    [&](){ view->updateTargetItems(); });
+        }
+
+        bodyItem->removeFromParentItem();
+        QCoreApplication::processEvents();
+    }
+
+    view->setListMode(orgListMode);
+    view->setTargetMode(orgTargetMode);
+}
+
+/**
+   The searches of the index are measured with 50,000 items in ten body items. Each search is
+   expected to finish within 1 ms. The searches followed by the sorting into the tree order,
+   which the view does for the found items, are also measured.
+*/
+void BodyPositionBenchmark::measureIndexSearch()
+{
+    const int numItems = 50000;
+    const int numBodies = 10;
+    auto index = BodyPositionItemIndex::instance();
+
+    vector<BodyItemPtr> bodyItems;
+    BodyPositionItem::beginItemsInProjectChangeBatch();
+    for(int i=0; i < numBodies; ++i){
+        BodyItemPtr bodyItem = new BodyItem;
+        bodyItem->setName(format("BenchmarkBody{0}", i));
+        for(int j=i; j < numItems; j += numBodies){
+            auto item = new BodyPositionItem;
+            item->setName(format("Position{0}", j));
+            item->setFlagColor(j % BodyPositionItem::NumFlagColors);
+            bodyItem->addChildItem(item);
+        }
+        RootItem::instance()->addChildItem(bodyItem);
+        bodyItems.push_back(bodyItem);
+    }
+    BodyPositionItem::endItemsInProjectChangeBatch();
+    QCoreApplication::processEvents();
+
+    vector<pair<string, BodyPositionItemIndex::Filter>> searches(4);
+    searches[0].first = "name";
+    searches[0].second.namePrefix = "position123";
+    searches[1].first = "owner";
+    searches[1].second.owner = bodyItems[3];
+    searches[2].first = "color";
+    searches[2].second.flagColor = BodyPositionItem::Green;
+    searches[3].first = "nameAndColor";
+    searches[3].second.namePrefix = "Position1";
+    searches[3].second.flagColor = BodyPositionItem::Red;
+
+    for(auto& search : searches){
+        measure(format("BodyPositionItemIndex::find.{0}", search.first), numItems, 100,
+                [&](){ index->find(search.second); });
+        auto& result = results.back();
+        if(result.seconds / result.numIterations > 1.0e-3){
+            mvout() << format("{0} exceeds the target of 1 ms.", result.name) << endl;
+        }
+        measure(format("BodyPositionItemIndex::find.{0}.treeOrder", search.first), numItems, 100,
+                [&](){
+                    auto items = index->find(search.second);
+                    BodyPositionItemIndex::sort(items, BodyPositionItemIndex::NoSorting, false);
+                });
+    }
+
+    for(auto& bodyItem : bodyItems){
+        bodyItem->removeFromParentItem();
+    }
+    QCoreApplication::processEvents();
+}
+
+/**
+   The heap usage per item is measured for the items without scenes and the items whose
+   flag scenes have been created.
+*/
+void BodyPositionBenchmark::measureMemoryUsage()
+{
+    const int numItems = 10000;
+    mvout() << format("sizeof(BodyPositionItem): {0} bytes", sizeof(BodyPositionItem)) << endl;
+    memoryResults.push_back({ "sizeof", 1, static_cast<double>(sizeof(BodyPositionItem)) });
+
+    if(getHeapUsage() < 0.0){
+        mvout() << "The heap usage cannot be measured on this platform." << endl;
+        return;
+    }
+    for(int withScene = 0; withScene < 2; ++withScene){
+        string name = withScene ? "heap.withScene" : "heap";
+        vector<BodyPositionItemPtr> items;
+        items.reserve(numItems);
+        double base = getHeapUsage();
+        for(int i=0; i < numItems; ++i){
+            items.push_back(new BodyPositionItem);
+            if(withScene){
+                items.back()->getScene();
+            }
+        }
+        double bytesPerItem = (getHeapUsage() - base) / numItems;
+        memoryResults.push_back({ name, numItems, bytesPerItem });
+        mvout() << format("{0} ({1} items): {2:.1f} bytes per item", name, numItems, bytesPerItem) << endl;
+    }
+}
+
+bool BodyPositionBenchmark::writeResults(const std::string& outputFile)
+{
+    auto fp = std::fopen(outputFile.c_str(), "w");
+    if(!fp){
+        mvout() << format("\"{0}\" cannot be created.", outputFile) << endl;
+        return false;
+    }
+    print(fp, "{{\n  \"benchmark\": \"BodyPositionItem\",\n  \"results\": [\n");
+    for(size_t i=0; i < results.size(); ++i){
+        auto& result = results[i];
+        print(fp,
+              "    {{ \"name\": \"{0}\", \"items\": {1}, \"iterations\": {2}, "
+              "\"total_seconds\": {3:.9g}, \"mean_microseconds\": {4:.6g} }}{5}\n",
+              result.name, result.numItems, result.numIterations, result.seconds,
+              result.seconds * 1.0e6 / result.numIterations, (i + 1 < results.size()) ? "," : "");
+    }
+    print(fp, "  ],\n  \"memory\": [\n");
+    for(size_t i=0; i < memoryResults.size(); ++i){
+        auto& result = memoryResults[i];
+        print(fp, "    {{ \"name\": \"{0}\", \"items\": {1}, \"bytes_per_item\": {2:.6g} }}{3}\n",
+              result.name, result.numItems, result.bytesPerItem, (i + 1 < memoryResults.size()) ? "," : "");
+    }
+    print(fp, "  ]\n}}\n");
+    bool failed = std::ferror(fp);
+    return (std::fclose(fp) == 0) && !failed;
+}
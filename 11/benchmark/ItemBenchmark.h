@@ -0,0 +1,50 @@
+#ifndef DEVGUIDE_PLUGIN_ITEM_BENCHMARK_H
+#define DEVGUIDE_PLUGIN_ITEM_BENCHMARK_H
+
+#include <cnoid/ExtensionManager>
+#include <string>
+#include <vector>
+
+/**
+   This class measures the hot paths of BodyPositionItem and BodyPositionItemView in the running
+   application and writes the results to a JSON file. The benchmarks are run when Choreonoid is
+   started with the --body-position-benchmark option.
+*/
+class BodyPositionBenchmark
+{
+public:
+    static void initializeClass(cnoid::ExtensionManager* ext);
+
+    bool run(const std::string& outputFile);
+
+private:
+    struct Result
+    {
+        std::string name;
+        int numItems;
+        int numIterations;
+        double seconds;
+    };
+    std::vector<Result> results;
+
+    struct MemoryResult
+    {
+        std::string name;
+        int numItems;
+        double bytesPerItem;
+    };
+    std::vector<MemoryResult> memoryResults;
+
+    template<class Function>
+    void measure(const std::string& name, int numItems, int numIterations, Function func);
+    void measureFileIo();
+    void measureFlagCreation();
+    void measureStoreAndRestore();
+    void measureDuplication();
+    void measureViewUpdate();
+    void measureIndexSearch();
+    void measureMemoryUsage();
+    bool writeResults(const std::string& outputFile);
+};
+
+#endif // DEVGUIDE_PLUGIN_ITEM_BENCHMARK_H
@@ -0,0 +1,69 @@
+#include "../BodyPositionParser.h"
+#include "../BodyPositionWriter.h"
+#include <cnoid/YAMLReader>
+#include <cnoid/EigenArchive>
+#include <fmt/format.h>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// Reads the values in the same way as the former loadBodyPosition function
+bool loadWithYAMLReader(const string& filename, Vector3& translation, Vector3& rotation)
+{
+    YAMLReader reader;
+    MappingPtr archive = reader.loadDocument(filename)->toMapping();
+    double flagHeight;
+    string flagColor;
+    read(archive, "translation", translation);
+    read(archive, "rotation", rotation);
+    archive->read("flag_height", flagHeight);
+    archive->read("flag_color", flagColor);
+    return true;
+}
+
+template<class Function>
+double measure(int n, Function func)
+{
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i < n; ++i){
+        func();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int n = (argc >= 2) ? std::atoi(argv[1]) : 100000;
+    string filename = (argc >= 3) ? argv[2] : "body-position-benchmark.pos";
+
+    BodyPositionWriter writer;
+    if(!writer.openFile(filename)){
+        fmt::print(stderr, "\"{0}\" cannot be created.\n", filename);
+        return 1;
+    }
+    writer.putBodyPosition(Vector3(1.234567, -0.5, 0.0), Vector3(0.0, 0.0, 90.0), 1.8, "Red");
+    writer.closeFile();
+
+    BodyPositionParser parser;
+    Vector3 translation, rotation;
+
+    double fastTime = measure(n, [&](){ parser.parseFile(filename); });
+    double yamlTime = measure(n, [&](){ loadWithYAMLReader(filename, translation, rotation); });
+
+    fmt::print("Parsed {0} files\n", n);
+    fmt::print("BodyPositionParser: {0:.3f} s, {1:.0f} files/s\n", fastTime, n / fastTime);
+    fmt::print("YAMLReader: {0:.3f} s, {1:.0f} files/s\n", yamlTime, n / yamlTime);
+    fmt::print("Speedup: {0:.1f}x\n", yamlTime / fastTime);
+
+    std::remove(filename.c_str());
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "../PoseSequenceCodec.h"
+#include "../PoseStreamFormat.h"
+#include <fmt/format.h>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+using namespace std;
+
+namespace {
+
+// The poses of a body moving along a circle and turning around the z axis at 1 kHz
+vector<double> createFrames(int numFrames, int numBodies)
+{
+    const int frameLength = 1 + PoseStreamValuesPerPose * numBodies;
+    vector<double> frames(static_cast<size_t>(numFrames) * frameLength);
+    for(int i=0; i < numFrames; ++i){
+        double time = i * 0.001;
+        double* v = &frames[static_cast<size_t>(i) * frameLength];
+        v[0] = time;
+        for(int j=0; j < numBodies; ++j){
+            double* p = v + 1 + j * PoseStreamValuesPerPose;
+            double angle = 0.5 * time + j;
+            p[0] = 2.0 * std::cos(angle);
+            p[1] = 2.0 * std::sin(angle);
+            p[2] = 0.8 + 0.05 * std::sin(3.0 * time);
+            double roll = 0.1 * std::sin(2.0 * time + j);
+            p[3] = std::sin(roll / 2.0);
+            p[4] = 0.0;
+            p[5] = std::sin(angle / 2.0) * std::cos(roll / 2.0);
+            p[6] = std::cos(angle / 2.0) * std::cos(roll / 2.0);
+        }
+    }
+    return frames;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int numFrames = (argc >= 2) ? std::atoi(argv[1]) : 600000;
+    int numBodies = (argc >= 3) ? std::atoi(argv[2]) : 1;
+    double translationTolerance = (argc >= 4) ? std::atof(argv[3]) : 1.0e-4;
+    double rotationTolerance = (argc >= 5) ? std::atof(argv[4]) : 1.0e-3;
+
+    vector<string> bodyNames;
+    for(int j=0; j < numBodies; ++j){
+        bodyNames.push_back(fmt::format("Body{0}", j));
+    }
+    auto frames = createFrames(numFrames, numBodies);
+
+    PoseSequenceCodec codec;
+    codec.setTranslationTolerance(translationTolerance);
+    codec.setRotationTolerance(rotationTolerance);
+    string data;
+    string error;
+    if(!codec.encode(bodyNames, frames.data(), numFrames, data, error)){
+        fmt::print(stderr, "{0}\n", error);
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<string> decodedBodyNames;
+    vector<double> decodedFrames;
+    if(!PoseSequenceCodec::decode(data.data(), data.size(), decodedBodyNames, decodedFrames, error)){
+        fmt::print(stderr, "{0}\n", error);
+        return 1;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    double maxTranslationError = 0.0;
+    double maxRotationError = 0.0;
+    const int frameLength = 1 + PoseStreamValuesPerPose * numBodies;
+    for(int i=0; i < numFrames; ++i){
+        for(int j=0; j < numBodies; ++j){
+            size_t index = static_cast<size_t>(i) * frameLength + 1 + j * PoseStreamValuesPerPose;
+            const double* p0 = &frames[index];
+            const double* p1 = &decodedFrames[index];
+            for(int k=0; k < 3; ++k){
+                maxTranslationError = std::max(maxTranslationError, std::fabs(p1[k] - p0[k]));
+            }
+            double dot = std::fabs(p0[3] * p1[3] + p0[4] * p1[4] + p0[5] * p1[5] + p0[6] * p1[6]);
+            double norm = std::sqrt(p1[3] * p1[3] + p1[4] * p1[4] + p1[5] * p1[5] + p1[6] * p1[6]);
+            maxRotationError = std::max(maxRotationError, 2.0 * std::acos(std::min(1.0, dot / norm)));
+        }
+    }
+
+    size_t rawSize = sizeof(PoseStreamHeader) + static_cast<size_t>(numFrames) * getPoseStreamFrameSize(numBodies);
+    fmt::print("Encoded {0} frames of {1} bodies\n", numFrames, numBodies);
+    fmt::print("Pose stream: {0} bytes, encoded: {1} bytes, ratio: {2:.1f}x\n",
+               rawSize, data.size(), static_cast<double>(rawSize) / data.size());
+    fmt::print("Max errors: translation {0:.3g} m (tolerance {1:.3g}), rotation {2:.3g} rad (tolerance {3:.3g})\n",
+               maxTranslationError, translationTolerance, maxRotationError, rotationTolerance);
+    fmt::print("Decoding: {0:.3f} s, {1:.0f} frames/s\n", elapsed.count(), numFrames / elapsed.count());
+
+    return (maxTranslationError <= translationTolerance * (1.0 + 1.0e-9) &&
+            maxRotationError <= rotationTolerance) ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#ifndef DEVGUIDE_PLUGIN_EXPORTDECL_H
+# define DEVGUIDE_PLUGIN_EXPORTDECL_H
+
+# if defined _WIN32 || defined __CYGWIN__
+#  define DEVGUIDE_PLUGIN_DLLIMPORT __declspec(dllimport)
+#  define DEVGUIDE_PLUGIN_DLLEXPORT __declspec(dllexport)
+#  define DEVGUIDE_PLUGIN_DLLLOCAL
+# else
+#  if __GNUC__ >= 4
+#   define DEVGUIDE_PLUGIN_DLLIMPORT __attribute__ ((visibility("default")))
+#   define DEVGUIDE_PLUGIN_DLLEXPORT __attribute__ ((visibility("default")))
+#   define DEVGUIDE_PLUGIN_DLLLOCAL  __attribute__ ((visibility("hidden")))
+#  else
+#   define DEVGUIDE_PLUGIN_DLLIMPORT
+#   define DEVGUIDE_PLUGIN_DLLEXPORT
+#   define DEVGUIDE_PLUGIN_DLLLOCAL
+#  endif
+# endif
+
+# ifdef CnoidDevGuidePlugin_EXPORTS
+#  define DEVGUIDE_PLUGIN_DLLAPI DEVGUIDE_PLUGIN_DLLEXPORT
+# else
+#  define DEVGUIDE_PLUGIN_DLLAPI DEVGUIDE_PLUGIN_DLLIMPORT
+# endif
+
+#endif
+
+// The classes used by the Python module are exported from the plugin library
+# undef CNOID_EXPORT
+# define CNOID_EXPORT DEVGUIDE_PLUGIN_DLLAPI
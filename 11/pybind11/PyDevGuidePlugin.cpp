@@ -0,0 +1,103 @@
+#include "../BodyPositionItem.h"
+#include <cnoid/PyUtil>
+#include <cnoid/PyEigenTypes>
+#include <pybind11/numpy.h>
+#include <fmt/format.h>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+namespace py = pybind11;
+
+namespace {
+
+typedef py::array_t<double, py::array::c_style | py::array::forcecast> DoubleArray;
+
+ItemList<BodyPositionItem> getTargetItems(py::object items)
+{
+    if(items.is_none()){
+        return BodyPositionItem::registeredItems();
+    }
+    ItemList<BodyPositionItem> targetItems;
+    for(auto item : items){
+        targetItems.push_back(item.cast<BodyPositionItem*>());
+    }
+    return targetItems;
+}
+
+/**
+   The translations are returned as an N x 3 array and the rotations are returned as an N x 4
+   array of the quaternions in the (x, y, z, w) order. The arrays are filled in one pass from
+   the stored translations and quaternions.
+*/
+py::tuple getPoses(py::object items)
+{
+    auto targetItems = getTargetItems(items);
+    py::ssize_t n = targetItems.size();
+    DoubleArray translations({ n, py::ssize_t(3) });
+    DoubleArray quaternions({ n, py::ssize_t(4) });
+    auto t = translations.mutable_unchecked<2>();
+    auto q = quaternions.mutable_unchecked<2>();
+    for(py::ssize_t i=0; i < n; ++i){
+        auto& item = targetItems[i];
+        auto& p = item->translation();
+        t(i, 0) = p.x();
+        t(i, 1) = p.y();
+        t(i, 2) = p.z();
+        auto& quat = item->rotation();
+        q(i, 0) = quat.x();
+        q(i, 1) = quat.y();
+        q(i, 2) = quat.z();
+        q(i, 3) = quat.w();
+    }
+    return py::make_tuple(translations, quaternions);
+}
+
+// The quaternions are normalized by BodyPositionItem::setPosition
+void setPoses(DoubleArray translations, DoubleArray quaternions, py::object items)
+{
+    auto targetItems = getTargetItems(items);
+    py::ssize_t n = targetItems.size();
+    if(translations.ndim() != 2 || translations.shape(0) != n || translations.shape(1) != 3){
+        throw py::value_error(format("The translations must be a {0} x 3 array.", n));
+    }
+    if(quaternions.ndim() != 2 || quaternions.shape(0) != n || quaternions.shape(1) != 4){
+        throw py::value_error(format("The quaternions must be a {0} x 4 array.", n));
+    }
+    auto t = translations.unchecked<2>();
+    auto q = quaternions.unchecked<2>();
+    for(py::ssize_t i=0; i < n; ++i){
+        targetItems[i]->setPosition(
+            Vector3(t(i, 0), t(i, 1), t(i, 2)), Quaternion(q(i, 3), q(i, 0), q(i, 1), q(i, 2)));
+    }
+}
+
+}
+
+PYBIND11_MODULE(DevGuidePlugin, m)
+{
+    m.doc() = "Choreonoid DevGuidePlugin module";
+
+    py::module::import("cnoid.BodyPlugin");
+
+    py::class_<BodyPositionItem, BodyPositionItemPtr, Item>(m, "BodyPositionItem")
+        .def(py::init<>())
+        .def_property("position",
+                      [](BodyPositionItem& self){ return Isometry3(self.position()); },
+                      [](BodyPositionItem& self, const Isometry3& T){ self.setPosition(T); })
+        .def_property("flagHeight", &BodyPositionItem::flagHeight, &BodyPositionItem::setFlagHeight)
+        .def("storeBodyPosition", &BodyPositionItem::storeBodyPosition)
+        .def("restoreBodyPosition", &BodyPositionItem::restoreBodyPosition)
+        .def_static("getNumRegisteredItems", &BodyPositionItem::numRegisteredItems)
+        .def_static("getRegisteredItems", [](){
+            py::list items;
+            for(auto& item : BodyPositionItem::registeredItems()){
+                items.append(BodyPositionItemPtr(item));
+            }
+            return items;
+        })
+        .def_static("getPoses", &getPoses, py::arg("items") = py::none())
+        .def_static("setPoses", &setPoses,
+                    py::arg("translations"), py::arg("quaternions"), py::arg("items") = py::none())
+        ;
+}
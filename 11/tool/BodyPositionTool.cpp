@@ -0,0 +1,441 @@
+#include "../BodyPositionParser.h"
+#include "../BodyPositionWriter.h"
+#include "../BodyPositionFormat.h"
+#include <cnoid/YAMLReader>
+#include <cnoid/EigenUtil>
+#include <cnoid/stdx/filesystem>
+#include <fmt/format.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace fmt;
+using namespace cnoid;
+namespace filesystem = cnoid::stdx::filesystem;
+
+namespace {
+
+typedef BodyPositionFormat::LengthUnit LengthUnit;
+typedef BodyPositionFormat::AngleUnit AngleUnit;
+
+struct Options
+{
+    string command;
+    vector<string> paths;
+    string output;
+    int numThreads;
+    LengthUnit inputLengthUnit;
+    LengthUnit outputLengthUnit;
+    AngleUnit inputAngleUnit;
+    AngleUnit outputAngleUnit;
+};
+
+struct Pose
+{
+    Vector3 translation;
+    Vector3 rotation;
+    double flagHeight;
+    string flagColor;
+};
+
+// The relative path is used to put the output file in the same place under the output directory
+struct InputFile
+{
+    filesystem::path path;
+    filesystem::path relativePath;
+};
+
+struct FileResult
+{
+    vector<Pose> poses;
+    string message;
+    bool failed;
+    FileResult() : failed(false) { }
+};
+
+void printUsage()
+{
+    print(stderr,
+          "Usage: BodyPositionTool <command> [options] <file or directory>...\n"
+          "Commands:\n"
+          "  validate  Check that the files can be read and have valid values\n"
+          "  convert   Convert the units of the files\n"
+          "  merge     Merge the files into the output file as YAML documents\n"
+          "  split     Split each file of multiple documents into files of single documents\n"
+          "Options:\n"
+          "  -o <path>                   Output file (merge) or directory (convert, split)\n"
+          "  -j <number>                 Number of the worker threads\n"
+          "  --from-length meter|millimeter\n"
+          "  --to-length meter|millimeter\n"
+          "  --from-angle degree|radian\n"
+          "  --to-angle degree|radian\n"
+          "The directories are searched recursively for the files with the .pos extension.\n");
+}
+
+bool parseArguments(int argc, char* argv[], Options& options)
+{
+    if(argc < 2){
+        return false;
+    }
+    options.command = argv[1];
+    options.numThreads = std::max(1u, std::thread::hardware_concurrency());
+    options.inputLengthUnit = BodyPositionFormat::Meter;
+    options.outputLengthUnit = BodyPositionFormat::Meter;
+    options.inputAngleUnit = BodyPositionFormat::Degree;
+    options.outputAngleUnit = BodyPositionFormat::Degree;
+
+    for(int i=2; i < argc; ++i){
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        bool isValid = true;
+        if(arg == "-o" && hasValue){
+            options.output = argv[++i];
+        } else if(arg == "-j" && hasValue){
+            options.numThreads = std::max(1, std::atoi(argv[++i]));
+        } else if(arg == "--from-length" && hasValue){
+            isValid = BodyPositionFormat::readLengthUnit(argv[++i], options.inputLengthUnit);
+        } else if(arg == "--to-length" && hasValue){
+            isValid = BodyPositionFormat::readLengthUnit(argv[++i], options.outputLengthUnit);
+        } else if(arg == "--from-angle" && hasValue){
+            isValid = BodyPositionFormat::readAngleUnit(argv[++i], options.inputAngleUnit);
+        } else if(arg == "--to-angle" && hasValue){
+            isValid = BodyPositionFormat::readAngleUnit(argv[++i], options.outputAngleUnit);
+        } else if(!arg.empty() && arg[0] == '-'){
+            isValid = false;
+        } else {
+            options.paths.push_back(arg);
+        }
+        if(!isValid){
+            print(stderr, "Invalid option: {0}\n", arg);
+            return false;
+        }
+    }
+    return !options.paths.empty();
+}
+
+// The leading components of the directory are removed from the path of a file found under it
+filesystem::path getPathUnderDirectory(const filesystem::path& file, const filesystem::path& directory)
+{
+    auto p = file.begin();
+    for(auto& element : directory){
+        if(p != file.end() && *p == element){
+            ++p;
+        }
+    }
+    filesystem::path relativePath;
+    for(; p != file.end(); ++p){
+        relativePath /= *p;
+    }
+    return relativePath;
+}
+
+bool collectInputFiles(const vector<string>& paths, vector<InputFile>& out_files)
+{
+    for(auto& path : paths){
+        filesystem::path root(path);
+        stdx::error_code ec;
+        if(filesystem::is_directory(root, ec)){
+            for(auto& entry : filesystem::recursive_directory_iterator(root, ec)){
+                auto& file = entry.path();
+                if(filesystem::is_regular_file(file, ec) && file.extension() == ".pos"){
+                    out_files.push_back({ file, getPathUnderDirectory(file, root) });
+                }
+            }
+        } else if(filesystem::exists(root, ec)){
+            out_files.push_back({ root, root.filename() });
+        } else {
+            print(stderr, "\"{0}\" does not exist.\n", path);
+            return false;
+        }
+    }
+    std::sort(out_files.begin(), out_files.end(),
+              [](const InputFile& a, const InputFile& b){ return a.path < b.path; });
+    return true;
+}
+
+// The files are processed by the worker threads in the order of the indices taken from the counter
+template<class Function>
+void processInParallel(size_t numFiles, int numThreads, Function func)
+{
+    atomic<size_t> nextIndex(0);
+    auto work = [&](){
+        for(size_t i = nextIndex++; i < numFiles; i = nextIndex++){
+            func(i);
+        }
+    };
+    vector<std::thread> workers;
+    for(int i=1; i < numThreads && (size_t)i < numFiles; ++i){
+        workers.emplace_back(work);
+    }
+    work();
+    for(auto& worker : workers){
+        worker.join();
+    }
+}
+
+bool readFileText(const string& filename, vector<char>& out_text, string& out_message)
+{
+    auto fp = std::fopen(filename.c_str(), "rb");
+    if(!fp){
+        out_message = format("\"{0}\" cannot be opened.", filename);
+        return false;
+    }
+    char buf[65536];
+    size_t size;
+    while((size = std::fread(buf, 1, sizeof(buf), fp)) > 0){
+        out_text.insert(out_text.end(), buf, buf + size);
+    }
+    bool failed = std::ferror(fp);
+    std::fclose(fp);
+    if(failed){
+        out_message = format("\"{0}\" cannot be read.", filename);
+        return false;
+    }
+    out_text.push_back('\0');
+    return true;
+}
+
+void addPose(const BodyPositionParser& parser, const Options& options, vector<Pose>& poses)
+{
+    if(!parser.hasTranslation && !parser.hasRotation && !parser.hasFlagHeight && !parser.hasFlagColor){
+        return; // Empty document
+    }
+    Pose pose;
+    pose.translation = parser.hasTranslation ? parser.translation : Vector3::Zero();
+    pose.rotation = parser.hasRotation ? parser.rotation : Vector3::Zero();
+    if(parser.hasFlagHeight){
+        pose.flagHeight = parser.flagHeight;
+    } else {
+        pose.flagHeight = BodyPositionFormat::defaultFlagHeight(options.inputLengthUnit);
+    }
+    if(parser.hasFlagColor){
+        pose.flagColor = parser.flagColor;
+    } else {
+        pose.flagColor = BodyPositionFormat::flagColorSymbol(BodyPositionFormat::DefaultFlagColor);
+    }
+    poses.push_back(pose);
+}
+
+/**
+   The documents in the simple form are read by BodyPositionParser one after another.
+   The whole file is read with YAMLReader if any of the documents is not in the simple form.
+*/
+bool loadPoses(const string& filename, const Options& options, vector<Pose>& out_poses, string& out_message)
+{
+    vector<char> text;
+    if(!readFileText(filename, text, out_message)){
+        return false;
+    }
+    BodyPositionParser parser;
+    size_t size = text.size() - 1;
+    size_t offset = 0;
+    bool isUnrecognized = false;
+    while(offset < size){
+        auto result = parser.parse(text.data() + offset, size - offset);
+        if(result == BodyPositionParser::Unrecognized){
+            isUnrecognized = true;
+            break;
+        }
+        if(result == BodyPositionParser::Error){
+            int line = std::count(text.begin(), text.begin() + offset, '\n') + parser.errorLine();
+            out_message = format("{0}:{1}:{2}: {3}", filename, line, parser.errorColumn(), parser.errorMessage());
+            return false;
+        }
+        addPose(parser, options, out_poses);
+        offset += parser.parsedSize();
+    }
+
+    if(isUnrecognized){
+        out_poses.clear();
+        try {
+            YAMLReader reader;
+            if(!reader.load(filename)){
+                out_message = reader.errorMessage();
+                return false;
+            }
+            for(int i=0; i < reader.numDocuments(); ++i){
+                auto node = reader.document(i);
+                if(!node->isMapping()){
+                    out_message = format("{0}: Document {1} is not a mapping.", filename, i + 1);
+                    return false;
+                }
+                if(!parser.readMapping(node->toMapping())){
+                    out_message = format("{0}: {1}", filename, parser.errorMessage());
+                    return false;
+                }
+                addPose(parser, options, out_poses);
+            }
+        }
+        catch(const ValueNode::Exception& ex){
+            out_message = format("{0}: {1}", filename, ex.message());
+            return false;
+        }
+    }
+    return true;
+}
+
+void convertUnits(vector<Pose>& poses, const Options& options)
+{
+    double lengthRatio = BodyPositionFormat::lengthRatio(options.inputLengthUnit, options.outputLengthUnit);
+    double angleRatio = BodyPositionFormat::angleRatio(options.inputAngleUnit, options.outputAngleUnit);
+    for(auto& pose : poses){
+        pose.translation *= lengthRatio;
+        pose.flagHeight *= lengthRatio;
+        pose.rotation *= angleRatio;
+    }
+}
+
+// The file is written to a temporary file first so that a failure does not break the existing file
+bool savePoses
+(const filesystem::path& path, const Pose* poses, size_t numPoses, string& out_message)
+{
+    stdx::error_code ec;
+    if(path.has_parent_path()){
+        filesystem::create_directories(path.parent_path(), ec);
+    }
+    string filename = path.string();
+    string tmpFilename = filename + ".tmp";
+    BodyPositionWriter writer;
+    if(!writer.openFile(tmpFilename)){
+        out_message = format("\"{0}\" cannot be created.", tmpFilename);
+        return false;
+    }
+    for(size_t i=0; i < numPoses; ++i){
+        auto& pose = poses[i];
+        writer.putBodyPosition(pose.translation, pose.rotation, pose.flagHeight, pose.flagColor);
+    }
+    if(!writer.closeFile()){
+        out_message = format("\"{0}\" cannot be written.", tmpFilename);
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+    filesystem::rename(tmpFilename, path, ec);
+    if(ec){
+        out_message = format("\"{0}\" cannot be renamed to \"{1}\": {2}", tmpFilename, filename, ec.message());
+        std::remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+string validatePoses(const vector<Pose>& poses)
+{
+    string message;
+    for(size_t i=0; i < poses.size(); ++i){
+        auto& pose = poses[i];
+        if(!(pose.flagHeight > 0.0)){
+            message += format(" Document {0}: The flag height must be positive.", i + 1);
+        }
+        if(BodyPositionFormat::findFlagColor(pose.flagColor) < 0){
+            message += format(" Document {0}: Unknown flag color \"{1}\".", i + 1, pose.flagColor);
+        }
+        if(!pose.translation.allFinite() || !pose.rotation.allFinite()){
+            message += format(" Document {0}: The values must be finite.", i + 1);
+        }
+    }
+    return message;
+}
+
+filesystem::path getOutputPath(const InputFile& file, const Options& options)
+{
+    if(options.output.empty()){
+        return file.path;
+    }
+    return filesystem::path(options.output) / file.relativePath;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if(!parseArguments(argc, argv, options)){
+        printUsage();
+        return 1;
+    }
+    auto& command = options.command;
+    if(command != "validate" && command != "convert" && command != "merge" && command != "split"){
+        print(stderr, "Unknown command: {0}\n", command);
+        printUsage();
+        return 1;
+    }
+    if(command == "merge" && options.output.empty()){
+        print(stderr, "The output file must be specified by the -o option for merging.\n");
+        return 1;
+    }
+
+    vector<InputFile> files;
+    if(!collectInputFiles(options.paths, files)){
+        return 1;
+    }
+
+    vector<FileResult> results(files.size());
+
+    processInParallel(files.size(), options.numThreads, [&](size_t index){
+        auto& file = files[index];
+        auto& result = results[index];
+        if(!loadPoses(file.path.string(), options, result.poses, result.message)){
+            result.failed = true;
+            return;
+        }
+        if(command == "validate"){
+            result.message = validatePoses(result.poses);
+            if(!result.message.empty()){
+                result.message = file.path.string() + ":" + result.message;
+                result.failed = true;
+            }
+            return;
+        }
+        convertUnits(result.poses, options);
+
+        if(command == "convert"){
+            auto& poses = result.poses;
+            result.failed = !savePoses(getOutputPath(file, options), poses.data(), poses.size(), result.message);
+
+        } else if(command == "split" && result.poses.size() > 1){
+            auto outputPath = getOutputPath(file, options);
+            auto stem = outputPath.stem().string();
+            int numDigits = std::to_string(result.poses.size()).size();
+            for(size_t i=0; i < result.poses.size(); ++i){
+                auto path = outputPath.parent_path() / format("{0}-{1:0{2}}.pos", stem, i + 1, numDigits);
+                if(!savePoses(path, &result.poses[i], 1, result.message)){
+                    result.failed = true;
+                    break;
+                }
+            }
+        }
+    });
+
+    int numFailures = 0;
+    size_t numDocuments = 0;
+    for(auto& result : results){
+        if(result.failed){
+            ++numFailures;
+            print(stderr, "{0}\n", result.message);
+        }
+        numDocuments += result.poses.size();
+    }
+
+    // The merged documents are written in the order of the paths
+    if(command == "merge" && numFailures == 0){
+        vector<Pose> poses;
+        poses.reserve(numDocuments);
+        for(auto& result : results){
+            poses.insert(poses.end(), result.poses.begin(), result.poses.end());
+        }
+        string message;
+        if(!savePoses(options.output, poses.data(), poses.size(), message)){
+            print(stderr, "{0}\n", message);
+            return 1;
+        }
+    }
+
+    print("{0} files, {1} documents, {2} failures\n", files.size(), numDocuments, numFailures);
+
+    return (numFailures == 0) ? 0 : 1;
+}